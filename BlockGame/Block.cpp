@@ -15,8 +15,9 @@
  */
 
 #include "Block.h"
+#include "VAOManager.h"
 
-Block::Block(void)
+Block::Block(void) : shape(NULL), vao(0)
 {
     this->position = glm::vec3(0.0);
 
@@ -117,23 +118,10 @@ Block::Block(void)
     this->normals[35]  = glm::i8vec4( 0,  0,  1, 0);
 }
 
-bool Block::Init(GLuint vao)
+bool Block::Init(VAO *shape)
 {
-    this->vao = vao;
-    //glGenVertexArrays(1, &this->vao);
-    //glBindVertexArray(this->vao);
-
-    glGenBuffers(1, &this->vbo_vertex);
-    glBindBuffer(GL_ARRAY_BUFFER, this->vbo_vertex);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glVertexAttribIPointer(BLOCK_ATTRIB_VERTEX, 4, GL_BYTE, 0, NULL);
-    glEnableVertexAttribArray(BLOCK_ATTRIB_VERTEX);
-
-    glGenBuffers(1, &this->vbo_normal);
-    glBindBuffer(GL_ARRAY_BUFFER, this->vbo_normal);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(normals), normals, GL_STATIC_DRAW);
-    glVertexAttribIPointer(BLOCK_ATTRIB_NORMAL, 4, GL_BYTE, 0, NULL);
-    glEnableVertexAttribArray(BLOCK_ATTRIB_NORMAL);
+    this->shape = shape;
+    this->vao = shape->id;
 
     return true;
 }
@@ -17,6 +17,8 @@
 #ifndef BLOCK_H
 #define BLOCK_H
 
+#include <string.h>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -27,13 +29,42 @@
 
 #define BLOCK_ATTRIB_VERTEX 0
 #define BLOCK_ATTRIB_NORMAL 1
+#define BLOCK_ATTRIB_INSTANCE 2
 
 #define BLOCK_SIZE 32
 
 #define BLOCK_VERTEX_COMPONENT_BITS 5
 
+// type 0 is empty space, every other type is solid
+#define BLOCK_TYPE_AIR 0
+#define BLOCK_TYPE_STONE 1
+#define BLOCK_TYPE_DIRT 2
+#define BLOCK_TYPE_GRASS 3
+#define BLOCK_TYPE_SAND 4
+#define BLOCK_TYPE_SNOW 5
+
+/* the state of one block, chunks keep a palette of the distinct states they
+ * hold, extra data lives in a side table of the chunk
+ */
 class NewBlock : public Object<NewBlock>
 {
+public:
+    NewBlock(unsigned short type = BLOCK_TYPE_AIR) : type(type)
+    {
+        memset(this->vertices, 0, sizeof(this->vertices));
+    }
+
+    inline unsigned short GetType(void) const { return this->type; }
+    inline void SetType(unsigned short type) { this->type = type; }
+
+    inline bool IsSolid(void) const { return this->type != BLOCK_TYPE_AIR; }
+
+    inline bool operator==(const NewBlock &other) const
+    {
+        return this->type == other.type && !memcmp(this->vertices, other.vertices, sizeof(this->vertices));
+    }
+    inline bool operator!=(const NewBlock &other) const { return !(*this == other); }
+protected:
     // TODO: find a way to make this significantly smaller
     // maybe calculate surface normals in the Chunk
     // no need to keep the normal data stored
@@ -51,17 +82,14 @@ class NewBlock : public Object<NewBlock>
 
     // block type id from 0 to 65535
     unsigned short type;
-
-    // pointer to extra data
-    void *data;
 } __attribute__((packed));
 
 class Block : public Object<Block>
 {
 protected:
+    // shared with every block of the same shape, see VAOManager
+    struct VAO *shape;
     GLuint vao;
-    GLuint vbo_vertex;
-    GLuint vbo_normal;
 
     glm::i8vec4 vertices[36];
     glm::i8vec4 normals[36];
@@ -75,6 +103,7 @@ public:
     {
         return this->vao;
     }
+    inline struct VAO * GetShape(void) { return this->shape; }
     inline glm::i8vec4 * GetVertices(void)
     {
         return this->vertices;
@@ -122,7 +151,7 @@ public:
         this->UpdateMatrix();
     }
 
-    bool Init(GLuint vao);
+    bool Init(struct VAO *shape);
 
     inline bool Draw(GLint u_matModelView)
     {
@@ -122,7 +122,7 @@ bool BlockGame::InitGLEW(void)
     return true;
 }
 
-bool BlockGame::InitShaders(const char *v_path, const char *f_path)
+bool BlockGame::InitShaders(const char *v_path, const char *f_path, GLuint *program_id)
 {
     long v_len, f_len;
     const char *v_src = ResourceManager::Load(v_path, &v_len);
@@ -166,15 +166,20 @@ bool BlockGame::InitShaders(const char *v_path, const char *f_path)
         return false;
     }
 
-    this->program_id = glCreateProgram();
-    glAttachShader(this->program_id, v_id);
-    glAttachShader(this->program_id, f_id);
+    *program_id = glCreateProgram();
+    glAttachShader(*program_id, v_id);
+    glAttachShader(*program_id, f_id);
 
-    glBindAttribLocation(this->program_id, BLOCK_ATTRIB_VERTEX, "a_vVertex");
-    glBindAttribLocation(this->program_id, BLOCK_ATTRIB_NORMAL, "a_vNormal");
+    glBindAttribLocation(*program_id, BLOCK_ATTRIB_VERTEX, "a_vVertex");
+    glBindAttribLocation(*program_id, BLOCK_ATTRIB_NORMAL, "a_vNormal");
+    glBindAttribLocation(*program_id, BLOCK_ATTRIB_INSTANCE, "a_vInstance");
+    glBindAttribLocation(*program_id, CHUNK_ATTRIB_VERTEX, "a_uVertex");
 
-    glLinkProgram(this->program_id);
-    glUseProgram(this->program_id);
+    glLinkProgram(*program_id);
+    glUseProgram(*program_id);
+
+    GLint u_fBlockSize = glGetUniformLocation(*program_id, "u_fBlockSize");
+    glUniform1f(u_fBlockSize, BLOCK_SIZE);
 
     return true;
 }
@@ -193,7 +198,8 @@ bool BlockGame::Init(void)
 
     if(!this->InitSDL()) return false;
     if(!this->InitGLEW()) return false;
-    if(!this->InitShaders("basiclighting.vsh", "basiclighting.fsh")) return false;
+    if(!this->InitShaders("basiclighting.vsh", "basiclighting.fsh", &this->program_id)) return false;
+    if(!this->InitShaders("chunk.vsh", "basiclighting.fsh", &this->chunk_program_id)) return false;
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
@@ -206,9 +212,6 @@ bool BlockGame::Init(void)
     this->camera = glm::translate(this->camera, glm::vec3(-15.0f * BLOCK_SIZE, -5.0f * BLOCK_SIZE, 5.0f * BLOCK_SIZE));
     this->camera = glm::rotate(this->matIdentity, 180.0f, glm::vec3(0, 1, 0)) * this->camera;
 
-    GLint u_fBlockSize = glGetUniformLocation(this->program_id, "u_fBlockSize");
-    glUniform1f(u_fBlockSize, BLOCK_SIZE);
-
     this->blocks = new Block[GRID_TOTAL];
 
     for(unsigned long x=0; x<GRID_X; ++x)
@@ -217,22 +220,31 @@ bool BlockGame::Init(void)
         {
             for(unsigned long z=0; z<GRID_Z; ++z)
             {
-                VAO *vao = this->vao_manager.GetVAOFor(this->blocks[x + y * GRID_X + z * GRID_X * GRID_Y].GetVertices(), 36);
-                glBindVertexArray(vao->id);
+                Block *block = &this->blocks[x + y * GRID_X + z * GRID_X * GRID_Y];
 
-                this->blocks[x + y * GRID_X + z * GRID_X * GRID_Y].Init(vao->id);
-                this->blocks[x + y * GRID_X + z * GRID_X * GRID_Y].SetPosition(x * 2.0f * BLOCK_SIZE,
-                                                                               y * 2.0f * BLOCK_SIZE,
-                                                                               z * 2.0f * BLOCK_SIZE);
+                // identical blocks share one VAO and its VBOs
+                block->Init(this->vao_manager.Acquire(block->GetVertices(), block->GetNormals(), 36));
+                block->SetPosition(x * 2.0f * BLOCK_SIZE, y * 2.0f * BLOCK_SIZE, z * 2.0f * BLOCK_SIZE);
             }
         }
     }
 
-    printf("block: %lu\n", sizeof(NewBlock));
-    printf("chunk: %lu\n", sizeof(NewBlock) * CHUNK_TOTAL);
-    printf("grid:  %lu\n", sizeof(NewBlock) * CHUNK_TOTAL * GRID_TOTAL);
-    //return false;
-    this->chunks = new Chunk[GRID_TOTAL];
+    printf("blocks: %d sharing %lu VAOs\n", GRID_TOTAL, this->vao_manager.GetCount());
+
+    this->b_instanced = true;
+    this->InitInstances();
+
+    // chunks stream in around the camera from here on
+    this->view_radius = STREAM_VIEW_RADIUS;
+    this->frame = 0;
+    if(!this->streamer.Init(STREAM_WORLD_PATH)) return false;
+
+    this->b_chunks = true;
+    this->mesher_mode = MESHER_SIMPLE;
+
+    this->mesh_tickets = 0;
+    this->mesh_start = 0;
+    if(!this->mesh_queue.Init()) return false;
 
     // change first block
     //glm::i8vec4 *vertices = this->blocks[0].GetVertices();
@@ -240,6 +252,315 @@ bool BlockGame::Init(void)
     return true;
 }
 
+void BlockGame::InitInstances(void)
+{
+    // per-instance attributes are only core from 3.3
+    if(!GLEW_ARB_instanced_arrays)
+    {
+        fprintf(stderr, "::InitInstances: warning: GL_ARB_instanced_arrays unsupported, drawing blocks one by one\n");
+        this->b_instanced = false;
+        return;
+    }
+
+    // VAOs without an instance buffer read this instead
+    glVertexAttribI4i(BLOCK_ATTRIB_INSTANCE, 0, 0, 0, 0);
+
+    std::map<VAO *, std::vector<BlockInstance> > shapes;
+    for(unsigned long i=0; i<GRID_TOTAL; ++i)
+    {
+        BlockInstance instance;
+        glm::vec3 position = glm::round(this->blocks[i].GetPosition() / (2.0f * BLOCK_SIZE));
+        instance.position = glm::i16vec4(position.x, position.y, position.z, 1);
+        shapes[this->blocks[i].GetShape()].push_back(instance);
+    }
+
+    for(std::map<VAO *, std::vector<BlockInstance> >::iterator i=shapes.begin(); i!=shapes.end(); ++i)
+    {
+        BlockBatch batch;
+        batch.shape = i->first;
+        batch.num_instances = i->second.size();
+
+        // the shape is drawn as fans of six per face, as triangles they fit in one call
+        std::vector<GLushort> indices;
+        for(unsigned long face=0; face<batch.shape->size; face+=6)
+        {
+            for(GLushort t=1; t<5; ++t)
+            {
+                indices.push_back(face);
+                indices.push_back(face + t);
+                indices.push_back(face + t + 1);
+            }
+        }
+        batch.num_indices = indices.size();
+
+        glGenVertexArrays(1, &batch.vao);
+        glBindVertexArray(batch.vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, batch.shape->vbo_vertex);
+        glVertexAttribIPointer(BLOCK_ATTRIB_VERTEX, 4, GL_BYTE, 0, NULL);
+        glEnableVertexAttribArray(BLOCK_ATTRIB_VERTEX);
+
+        glBindBuffer(GL_ARRAY_BUFFER, batch.shape->vbo_normal);
+        glVertexAttribIPointer(BLOCK_ATTRIB_NORMAL, 4, GL_BYTE, 0, NULL);
+        glEnableVertexAttribArray(BLOCK_ATTRIB_NORMAL);
+
+        glGenBuffers(1, &batch.vbo_instance);
+        glBindBuffer(GL_ARRAY_BUFFER, batch.vbo_instance);
+        glBufferData(GL_ARRAY_BUFFER, i->second.size() * sizeof(BlockInstance), &i->second[0], GL_STATIC_DRAW);
+        glVertexAttribIPointer(BLOCK_ATTRIB_INSTANCE, 4, GL_SHORT, sizeof(BlockInstance),
+                               (const GLvoid *)offsetof(BlockInstance, position));
+        glVertexAttribDivisorARB(BLOCK_ATTRIB_INSTANCE, 1);
+        glEnableVertexAttribArray(BLOCK_ATTRIB_INSTANCE);
+
+        glGenBuffers(1, &batch.ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
+
+        this->batches.push_back(batch);
+    }
+
+    glBindVertexArray(0);
+}
+
+void BlockGame::DrawInstances(GLint u_matObject)
+{
+    // instances carry their own position
+    glUniformMatrix4fv(u_matObject, 1, GL_FALSE, glm::value_ptr(this->matIdentity));
+
+    for(std::vector<BlockBatch>::iterator i=this->batches.begin(); i!=this->batches.end(); ++i)
+    {
+        glBindVertexArray(i->vao);
+        glDrawElementsInstanced(GL_TRIANGLES, i->num_indices, GL_UNSIGNED_SHORT, NULL, i->num_instances);
+    }
+}
+
+glm::vec3 BlockGame::GetEye(void)
+{
+    // blocks are 2 * BLOCK_SIZE wide and centred on their grid point
+    glm::vec3 eye = glm::vec3(glm::inverse(this->camera)[3]);
+    return (eye + glm::vec3(BLOCK_SIZE)) / (2.0f * BLOCK_SIZE);
+}
+
+Chunk * BlockGame::GetChunk(int x, int y, int z)
+{
+    std::map<Uint64, Chunk *>::iterator i = this->chunks.find(ChunkKey(x, y, z));
+    return i == this->chunks.end() ? NULL : i->second;
+}
+
+void BlockGame::UpdateChunks(void)
+{
+    ++this->frame;
+
+    glm::vec3 eye = this->GetEye();
+    int cx = FloorDiv(glm::floor(eye.x), CHUNK_X);
+    int cy = FloorDiv(glm::floor(eye.y), CHUNK_Y);
+    int cz = FloorDiv(glm::floor(eye.z), CHUNK_Z);
+
+    // touch what is in view and ask for what is missing, nearest first
+    for(int x=cx-this->view_radius; x<=cx+this->view_radius; ++x)
+    {
+        for(int y=cy-this->view_radius; y<=cy+this->view_radius; ++y)
+        {
+            for(int z=cz-this->view_radius; z<=cz+this->view_radius; ++z)
+            {
+                Uint64 key = ChunkKey(x, y, z);
+
+                std::map<Uint64, Chunk *>::iterator i = this->chunks.find(key);
+                if(i != this->chunks.end()) i->second->last_used = this->frame;
+                else if(this->chunks_loading.insert(key).second)
+                {
+                    glm::vec3 centre = glm::vec3(x * CHUNK_X, y * CHUNK_Y, z * CHUNK_Z) +
+                                       glm::vec3(CHUNK_X, CHUNK_Y, CHUNK_Z) * 0.5f - eye;
+                    this->streamer.Load(x, y, z, glm::dot(centre, centre));
+                }
+            }
+        }
+    }
+
+    this->streamer.Prioritise(eye);
+
+    ChunkGenerateReport report;
+    if(this->streamer.GetGenerator()->TakeReport(&report))
+    {
+        printf("generator: %lu chunks in %.2f ms on %d threads, %.0f chunks/s, %.0f chunks/s per thread\n",
+               report.chunks, report.seconds * 1000.0, this->streamer.GetGenerator()->GetWorkerCount(),
+               report.chunks / report.seconds, report.chunks / report.busy_seconds);
+    }
+
+    for(ChunkLoadResult *r=this->streamer.Poll(), *next; r; r=next)
+    {
+        next = r->next;
+
+        Chunk *chunk = new Chunk(glm::vec3(r->x * CHUNK_X, r->y * CHUNK_Y, r->z * CHUNK_Z), r->storage);
+        chunk->last_used = this->frame;
+        chunk->mesh_uploaded = this->mesh_tickets;
+        chunk->b_dirty = true;
+
+        this->chunks_loading.erase(ChunkKey(r->x, r->y, r->z));
+        this->chunks[ChunkKey(r->x, r->y, r->z)] = chunk;
+
+        // neighbours meshed while this chunk was missing showed faces it now covers
+        Chunk *neighbour;
+        if((neighbour = this->GetChunk(r->x - 1, r->y, r->z))) neighbour->b_dirty = true;
+        if((neighbour = this->GetChunk(r->x + 1, r->y, r->z))) neighbour->b_dirty = true;
+        if((neighbour = this->GetChunk(r->x, r->y - 1, r->z))) neighbour->b_dirty = true;
+        if((neighbour = this->GetChunk(r->x, r->y + 1, r->z))) neighbour->b_dirty = true;
+        if((neighbour = this->GetChunk(r->x, r->y, r->z - 1))) neighbour->b_dirty = true;
+        if((neighbour = this->GetChunk(r->x, r->y, r->z + 1))) neighbour->b_dirty = true;
+
+        delete r;
+    }
+
+    unsigned long max_chunks = this->GetMaxChunks();
+    if(this->chunks.size() <= max_chunks) return;
+
+    // least recently used first, chunks in view this frame are never evicted
+    std::vector<std::pair<unsigned long, Uint64> > unused;
+    for(std::map<Uint64, Chunk *>::iterator i=this->chunks.begin(); i!=this->chunks.end(); ++i)
+    {
+        if(i->second->last_used != this->frame) unused.push_back(std::make_pair(i->second->last_used, i->first));
+    }
+    std::sort(unused.begin(), unused.end());
+
+    for(unsigned long i=0; i<unused.size() && this->chunks.size()>max_chunks; ++i)
+    {
+        this->EvictChunk(this->chunks.find(unused[i].second));
+    }
+}
+
+void BlockGame::EvictChunk(std::map<Uint64, Chunk *>::iterator i)
+{
+    Chunk *chunk = i->second;
+
+    // the neighbours keep their meshes, the faces they now show are at the edge of the resident world
+    if(chunk->b_modified)
+    {
+        glm::vec3 position = chunk->GetPosition();
+        this->streamer.Save(position.x / CHUNK_X, position.y / CHUNK_Y, position.z / CHUNK_Z, chunk->Snapshot());
+    }
+
+    delete chunk;
+    this->chunks.erase(i);
+}
+
+void BlockGame::SetBlock(int x, int y, int z, unsigned short type)
+{
+    int cx = FloorDiv(x, CHUNK_X), cy = FloorDiv(y, CHUNK_Y), cz = FloorDiv(z, CHUNK_Z);
+    int bx = x - cx * CHUNK_X, by = y - cy * CHUNK_Y, bz = z - cz * CHUNK_Z;
+
+    Chunk *chunk = this->GetChunk(cx, cy, cz);
+    if(!chunk) return;
+
+    chunk->SetType(bx, by, bz, type);
+
+    // blocks on a border also show in the neighbouring mesh
+    Chunk *neighbour;
+    if(bx == 0 && (neighbour = this->GetChunk(cx - 1, cy, cz))) neighbour->b_dirty = true;
+    if(bx == CHUNK_X - 1 && (neighbour = this->GetChunk(cx + 1, cy, cz))) neighbour->b_dirty = true;
+    if(by == 0 && (neighbour = this->GetChunk(cx, cy - 1, cz))) neighbour->b_dirty = true;
+    if(by == CHUNK_Y - 1 && (neighbour = this->GetChunk(cx, cy + 1, cz))) neighbour->b_dirty = true;
+    if(bz == 0 && (neighbour = this->GetChunk(cx, cy, cz - 1))) neighbour->b_dirty = true;
+    if(bz == CHUNK_Z - 1 && (neighbour = this->GetChunk(cx, cy, cz + 1))) neighbour->b_dirty = true;
+}
+
+void BlockGame::MeshChunk(int x, int y, int z, float priority)
+{
+    // in BlockFace order
+    const Chunk *neighbours[NUM_BLOCK_FACES] =
+    {
+        this->GetChunk(x - 1, y, z),
+        this->GetChunk(x + 1, y, z),
+        this->GetChunk(x, y - 1, z),
+        this->GetChunk(x, y + 1, z),
+        this->GetChunk(x, y, z - 1),
+        this->GetChunk(x, y, z + 1),
+    };
+
+    Chunk *chunk = this->GetChunk(x, y, z);
+
+    ChunkMeshJob job;
+    job.x = x;
+    job.y = y;
+    job.z = z;
+    job.ticket = ++this->mesh_tickets;
+    job.mode = this->mesher_mode;
+    job.priority = priority;
+
+    // later edits copy the blocks instead of changing what the job reads
+    job.chunk = chunk->Snapshot();
+    for(int face=0; face<NUM_BLOCK_FACES; ++face)
+    {
+        job.neighbours[face] = neighbours[face] ? neighbours[face]->Snapshot() : NULL;
+    }
+
+    this->mesh_queue.Submit(job);
+}
+
+void BlockGame::UpdateMeshes(void)
+{
+    glm::vec3 eye = this->GetEye();
+
+    for(std::map<Uint64, Chunk *>::iterator i=this->chunks.begin(); i!=this->chunks.end(); ++i)
+    {
+        Chunk *chunk = i->second;
+        if(!chunk->b_dirty) continue;
+
+        glm::vec3 position = chunk->GetPosition();
+        glm::vec3 centre = position + glm::vec3(CHUNK_X, CHUNK_Y, CHUNK_Z) * 0.5f - eye;
+        this->MeshChunk(position.x / CHUNK_X, position.y / CHUNK_Y, position.z / CHUNK_Z, glm::dot(centre, centre));
+        chunk->b_dirty = false;
+    }
+
+    // the camera may have moved since older jobs were queued
+    this->mesh_queue.Prioritise(eye);
+
+    for(ChunkMeshResult *r=this->mesh_queue.Poll(), *next; r; r=next)
+    {
+        next = r->next;
+
+        // the chunk may have been evicted, or a newer job may have finished first
+        Chunk *chunk = this->GetChunk(r->x, r->y, r->z);
+        if(chunk && r->ticket > chunk->mesh_uploaded)
+        {
+            chunk->Upload(r->vertices);
+            chunk->mesh_uploaded = r->ticket;
+            this->mesh_vertices += r->vertices.size();
+        }
+
+        delete r;
+    }
+
+    if(this->mesh_start && this->mesh_queue.IsIdle())
+    {
+        // palette storage against one NewBlock per block
+        unsigned long usage = 0;
+        for(std::map<Uint64, Chunk *>::iterator i=this->chunks.begin(); i!=this->chunks.end(); ++i)
+        {
+            usage += i->second->GetMemoryUsage();
+        }
+
+        printf("%s mesher: %lu chunks in %.2f ms on %d threads, %lu vertices\n",
+               ChunkMesher::mode_names[this->mesher_mode], this->mesh_chunks,
+               (SDL_GetPerformanceCounter() - this->mesh_start) * 1000.0 / SDL_GetPerformanceFrequency(),
+               this->mesh_queue.GetWorkerCount(), this->mesh_vertices);
+        printf("chunks: %lu resident in %lu bytes, %lu unpacked\n", (unsigned long)this->chunks.size(), usage,
+               (unsigned long)(sizeof(NewBlock) * CHUNK_TOTAL * this->chunks.size()));
+        this->mesh_start = 0;
+    }
+}
+
+void BlockGame::MeshAll(void)
+{
+    for(std::map<Uint64, Chunk *>::iterator i=this->chunks.begin(); i!=this->chunks.end(); ++i)
+    {
+        i->second->b_dirty = true;
+    }
+
+    this->mesh_start = SDL_GetPerformanceCounter();
+    this->mesh_chunks = this->chunks.size();
+    this->mesh_vertices = 0;
+}
+
 bool BlockGame::HandleSDL(SDL_Event *e)
 {
     switch(e->type)
@@ -247,6 +568,32 @@ bool BlockGame::HandleSDL(SDL_Event *e)
         case SDL_QUIT:
             return false;
         case SDL_KEYDOWN:
+            // toggles only act on the first press
+            if(!e->key.repeat)
+            {
+                switch(e->key.keysym.sym)
+                {
+                    case SDLK_m: // toggle chunk meshes and per-block drawing
+                        this->b_chunks = !this->b_chunks;
+                        break;
+                    case SDLK_i: // toggle instanced and per-block drawing of the block grid
+                        this->b_instanced = !this->b_instanced && !this->batches.empty();
+                        break;
+                    case SDLK_g: // cycle chunk mesher
+                        this->mesher_mode = (MesherMode)((this->mesher_mode + 1) % NUM_MESHER_MODES);
+                        this->MeshAll();
+                        break;
+                    case SDLK_EQUALS: // stream more chunks around the camera
+                        if(this->view_radius < STREAM_MAX_RADIUS) ++this->view_radius;
+                        printf("view radius: %d chunks\n", this->view_radius);
+                        break;
+                    case SDLK_MINUS: // stream fewer chunks, the rest are evicted as they age
+                        if(this->view_radius > 1) --this->view_radius;
+                        printf("view radius: %d chunks\n", this->view_radius);
+                        break;
+                }
+            }
+
             // remove key if already in pressed_keys
             for(std::vector<SDL_Keycode>::iterator i=this->pressed_keys.begin();
                 i!=this->pressed_keys.end();
@@ -347,25 +694,48 @@ bool BlockGame::Draw(void)
     glClearColor(0.6f, 0.65f, 0.9f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    this->UpdateChunks();
+    this->UpdateMeshes();
+
+    // chunks have their own packed vertex format
+    GLuint program_id = this->b_chunks ? this->chunk_program_id : this->program_id;
+    glUseProgram(program_id);
+
     glm::mat4 matProjection = glm::perspective(35.0f, this->width / this->height, 1.0f, 65536.0f);
-    GLint u_matProjection = glGetUniformLocation(this->program_id, "u_matProjection");
+    GLint u_matProjection = glGetUniformLocation(program_id, "u_matProjection");
     glUniformMatrix4fv(u_matProjection, 1, GL_FALSE, glm::value_ptr(matProjection));
 
-    GLint u_matModelView = glGetUniformLocation(this->program_id, "u_matModelView");
+    GLint u_matModelView = glGetUniformLocation(program_id, "u_matModelView");
     glUniformMatrix4fv(u_matModelView, 1, GL_FALSE, glm::value_ptr(this->camera));
 
-    GLint u_matObject = glGetUniformLocation(this->program_id, "u_matObject");
+    GLint u_matObject = glGetUniformLocation(program_id, "u_matObject");
 
-    GLuint bound_vao = 0;
-    for(unsigned long i=0; i<GRID_TOTAL; ++i)
+    if(this->b_chunks)
     {
-        GLuint current_vao = this->blocks[i].GetVAO();
-        if(current_vao != bound_vao)
+        // one draw per chunk holding only its visible faces
+        GLint u_vChunkOrigin = glGetUniformLocation(program_id, "u_vChunkOrigin");
+        for(std::map<Uint64, Chunk *>::iterator i=this->chunks.begin(); i!=this->chunks.end(); ++i)
         {
-            glBindVertexArray(current_vao);
-            bound_vao = current_vao;
+            i->second->Draw(u_vChunkOrigin);
+        }
+    }
+    else if(this->b_instanced)
+    {
+        this->DrawInstances(u_matObject);
+    }
+    else
+    {
+        GLuint bound_vao = 0;
+        for(unsigned long i=0; i<GRID_TOTAL; ++i)
+        {
+            GLuint current_vao = this->blocks[i].GetVAO();
+            if(current_vao != bound_vao)
+            {
+                glBindVertexArray(current_vao);
+                bound_vao = current_vao;
+            }
+            this->blocks[i].Draw(u_matObject);
         }
-        this->blocks[i].Draw(u_matObject);
     }
 
     SDL_GL_SwapWindow(this->wnd);
@@ -375,6 +745,22 @@ bool BlockGame::Draw(void)
 
 bool BlockGame::Destroy(void)
 {
+    this->mesh_queue.Destroy();
+
+    // write back every modified chunk before the streamer stops
+    while(!this->chunks.empty()) this->EvictChunk(this->chunks.begin());
+    this->streamer.Destroy();
+
+    for(std::vector<BlockBatch>::iterator i=this->batches.begin(); i!=this->batches.end(); ++i)
+    {
+        glDeleteBuffers(1, &i->vbo_instance);
+        glDeleteBuffers(1, &i->ibo);
+        glDeleteVertexArrays(1, &i->vao);
+    }
+    this->batches.clear();
+
+    for(unsigned long i=0; i<GRID_TOTAL; ++i) this->vao_manager.Release(this->blocks[i].GetShape());
+
     if(!this->DestroySDL()) return false;
     return true;
 }
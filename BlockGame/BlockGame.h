@@ -19,6 +19,9 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
+#include <map>
+#include <set>
 #include <vector>
 
 #include <SDL.h>
@@ -33,12 +36,40 @@
 #include "VAOManager.h"
 #include "Block.h"
 #include "Chunk.h"
+#include "ChunkMesher.h"
+#include "ChunkMeshQueue.h"
+#include "ChunkStreamer.h"
 
 #define GRID_X 8
 #define GRID_Y 8
 #define GRID_Z 8
 #define GRID_TOTAL (GRID_X * GRID_Y * GRID_Z)
 
+// chunks kept resident in every direction around the camera, adjustable at run time
+#define STREAM_VIEW_RADIUS 4
+#define STREAM_MAX_RADIUS 12
+
+// directory of the region files, relative to the working directory
+#define STREAM_WORLD_PATH "world"
+
+// one per block
+struct BlockInstance
+{
+    // grid position in blocks, type in w
+    glm::i16vec4 position;
+};
+
+// every block of one shape, drawn with a single instanced call
+struct BlockBatch
+{
+    VAO *shape;
+    GLuint vao;
+    GLuint vbo_instance;
+    GLuint ibo;
+    GLsizei num_indices;
+    GLsizei num_instances;
+};
+
 class BlockGame : Object<BlockGame>
 {
 protected:
@@ -52,12 +83,76 @@ protected:
     float height;
 
     GLuint program_id;
+    GLuint chunk_program_id;
 
     glm::mat4 matIdentity;
     glm::mat4 camera;
 
     Block *blocks;
-    Chunk *chunks;
+
+    // resident chunks by ChunkKey, and chunks asked of the streamer but not back yet
+    std::map<Uint64, Chunk *> chunks;
+    std::set<Uint64> chunks_loading;
+
+    ChunkStreamer streamer;
+    int view_radius;
+
+    // counts frames for the least recently used eviction of chunks
+    unsigned long frame;
+
+    std::vector<BlockBatch> batches;
+
+    // draw the block grid instanced instead of one draw per block
+    bool b_instanced;
+
+    // draw the meshed chunks instead of one Block per grid cell
+    bool b_chunks;
+    MesherMode mesher_mode;
+
+    ChunkMeshQueue mesh_queue;
+
+    // numbers mesh jobs across all chunks so a chunk loaded again ignores jobs of its old self
+    unsigned long mesh_tickets;
+
+    // set by MeshAll until every chunk is back from the workers
+    Uint64 mesh_start;
+    unsigned long mesh_chunks;
+    unsigned long mesh_vertices;
+
+    // groups the blocks by shape into instance buffers
+    void InitInstances(void);
+    void DrawInstances(GLint u_matObject);
+
+    // the camera position in blocks
+    glm::vec3 GetEye(void);
+
+    // NULL if the chunk is not resident
+    Chunk * GetChunk(int x, int y, int z);
+
+    // most chunks that may stay resident, twice the view volume so turning back rarely reloads
+    inline unsigned long GetMaxChunks(void) const
+    {
+        unsigned long side = 2 * this->view_radius + 1;
+        return 2 * side * side * side;
+    }
+
+    // asks for the chunks around the camera, takes in loaded ones and evicts the least recently used
+    void UpdateChunks(void);
+
+    // drops a chunk, queueing its blocks for writing if they changed since it was loaded
+    void EvictChunk(std::map<Uint64, Chunk *>::iterator i);
+
+    // changes a block by its position in blocks and marks the chunks that show it for remeshing, if resident
+    void SetBlock(int x, int y, int z, unsigned short type);
+
+    // hands a snapshot of the chunk and its neighbours to the mesh workers
+    void MeshChunk(int x, int y, int z, float priority);
+
+    // queues every dirty chunk nearest first and uploads whatever the workers finished
+    void UpdateMeshes(void);
+
+    // remeshes every resident chunk and prints how long it took once done
+    void MeshAll(void);
 public:
     void PrintShaderError(GLint shader);
 
@@ -65,7 +160,7 @@ public:
 
     bool InitSDL(void);
     bool InitGLEW(void);
-    bool InitShaders(const char *v_path, const char *f_path);
+    bool InitShaders(const char *v_path, const char *f_path, GLuint *program_id);
     bool DestroySDL(void);
 
     bool Init(void);
@@ -0,0 +1,267 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string.h>
+#include <algorithm>
+
+#include "Chunk.h"
+
+void ChunkStorage::Repack(unsigned int bits)
+{
+    std::vector<unsigned int> old_indices;
+    old_indices.swap(this->indices);
+    unsigned int old_bits = this->bits;
+
+    this->bits = bits;
+    if(bits == 0) return;
+
+    this->indices.assign((CHUNK_TOTAL * bits + CHUNK_WORD_BITS - 1) / CHUNK_WORD_BITS, 0);
+    if(old_bits == 0) return;
+
+    for(unsigned long i=0; i<CHUNK_TOTAL; ++i)
+    {
+        unsigned long bit = i * old_bits;
+        unsigned long index = (old_indices[bit / CHUNK_WORD_BITS] >> (bit % CHUNK_WORD_BITS)) & ((1u << old_bits) - 1);
+        this->SetIndex(i, index);
+    }
+}
+
+unsigned long ChunkStorage::FindOrAdd(const NewBlock &state)
+{
+    // palettes are small, a free slot is any entry no block uses any more
+    unsigned long free_slot = this->palette.size();
+    for(unsigned long p=0; p<this->palette.size(); ++p)
+    {
+        if(this->palette_counts[p] == 0)
+        {
+            if(free_slot == this->palette.size()) free_slot = p;
+        }
+        else if(this->palette[p] == state) return p;
+    }
+
+    if(free_slot < this->palette.size())
+    {
+        this->palette[free_slot] = state;
+        return free_slot;
+    }
+
+    this->palette.push_back(state);
+    this->palette_counts.push_back(0);
+
+    // widen the indices once the palette outgrows them
+    unsigned int bits = this->bits == 0 ? 1 : this->bits;
+    while((1ul << bits) < this->palette.size()) bits *= 2;
+    if(bits != this->bits) this->Repack(bits);
+
+    return this->palette.size() - 1;
+}
+
+void ChunkStorage::Set(unsigned long i, const NewBlock &state)
+{
+    unsigned long old_index = this->GetIndex(i);
+    if(this->palette[old_index] == state) return;
+
+    if(this->palette[old_index].IsSolid()) --this->num_solid;
+    if(state.IsSolid()) ++this->num_solid;
+
+    unsigned long index = this->FindOrAdd(state);
+    this->SetIndex(i, index);
+
+    ++this->palette_counts[index];
+
+    // the last block of a state is gone, collapse to a single value if only one is left
+    if(--this->palette_counts[old_index] == 0 && this->palette_counts[index] == CHUNK_TOTAL)
+    {
+        std::vector<NewBlock>(1, state).swap(this->palette);
+        std::vector<unsigned long>(1, CHUNK_TOTAL).swap(this->palette_counts);
+        this->Repack(0);
+    }
+}
+
+void ChunkStorage::Unpack(unsigned short *types) const
+{
+    if(this->bits == 0)
+    {
+        for(unsigned long i=0; i<CHUNK_TOTAL; ++i) types[i] = this->palette[0].GetType();
+        return;
+    }
+
+    // decode a word at a time
+    std::vector<unsigned short> palette_types(this->palette.size());
+    for(unsigned long p=0; p<this->palette.size(); ++p) palette_types[p] = this->palette[p].GetType();
+
+    unsigned int per_word = CHUNK_WORD_BITS / this->bits;
+    unsigned int mask = (1u << this->bits) - 1;
+    for(unsigned long w=0, i=0; i<CHUNK_TOTAL; ++w)
+    {
+        unsigned int word = this->indices[w];
+        for(unsigned int k=0; k<per_word && i<CHUNK_TOTAL; ++k, ++i, word >>= this->bits)
+        {
+            types[i] = palette_types[word & mask];
+        }
+    }
+}
+
+void ChunkStorage::Pack(const unsigned short *types)
+{
+    // runs of the same type are common, remember the last slot
+    std::vector<unsigned short> palette_types;
+    std::vector<unsigned long> counts;
+    std::vector<unsigned short> slots(CHUNK_TOTAL);
+    unsigned long last = 0;
+
+    for(unsigned long i=0; i<CHUNK_TOTAL; ++i)
+    {
+        if(palette_types.empty() || palette_types[last] != types[i])
+        {
+            last = std::find(palette_types.begin(), palette_types.end(), types[i]) - palette_types.begin();
+            if(last == palette_types.size())
+            {
+                palette_types.push_back(types[i]);
+                counts.push_back(0);
+            }
+        }
+
+        slots[i] = last;
+        ++counts[last];
+    }
+
+    this->palette.clear();
+    this->num_solid = 0;
+    for(unsigned long p=0; p<palette_types.size(); ++p)
+    {
+        this->palette.push_back(NewBlock(palette_types[p]));
+        if(this->palette[p].IsSolid()) this->num_solid += counts[p];
+    }
+    this->palette_counts.swap(counts);
+
+    unsigned int bits = 0;
+    if(this->palette.size() > 1) for(bits=1; (1ul << bits) < this->palette.size(); bits*=2);
+
+    this->indices.clear();
+    this->bits = 0;
+    this->Repack(bits);
+    if(bits) for(unsigned long i=0; i<CHUNK_TOTAL; ++i) this->SetIndex(i, slots[i]);
+}
+
+static inline void PutUint32(std::vector<unsigned char> *out, Uint32 value)
+{
+    value = SDL_SwapLE32(value);
+    const unsigned char *bytes = (const unsigned char *)&value;
+    out->insert(out->end(), bytes, bytes + sizeof(Uint32));
+}
+
+static inline bool GetUint32(const unsigned char **data, const unsigned char *end, Uint32 *value)
+{
+    if(end - *data < (long)sizeof(Uint32)) return false;
+
+    memcpy(value, *data, sizeof(Uint32));
+    *value = SDL_SwapLE32(*value);
+    *data += sizeof(Uint32);
+    return true;
+}
+
+void ChunkStorage::Serialize(std::vector<unsigned char> *out) const
+{
+    PutUint32(out, this->bits);
+    PutUint32(out, this->palette.size());
+
+    const unsigned char *palette = (const unsigned char *)&this->palette[0];
+    out->insert(out->end(), palette, palette + this->palette.size() * sizeof(NewBlock));
+
+    PutUint32(out, this->indices.size());
+    for(unsigned long i=0; i<this->indices.size(); ++i) PutUint32(out, this->indices[i]);
+}
+
+bool ChunkStorage::Deserialize(const unsigned char *data, unsigned long len)
+{
+    const unsigned char *end = data + len;
+
+    Uint32 bits, palette_size, num_words;
+    if(!GetUint32(&data, end, &bits) || !GetUint32(&data, end, &palette_size)) return false;
+
+    if(bits != 0 && bits != 1 && bits != 2 && bits != 4 && bits != 8 && bits != 16) return false;
+    if(palette_size == 0 || palette_size > (1ul << bits)) return false;
+    if((unsigned long)(end - data) < palette_size * sizeof(NewBlock)) return false;
+
+    std::vector<NewBlock> palette(palette_size);
+    memcpy(&palette[0], data, palette_size * sizeof(NewBlock));
+    data += palette_size * sizeof(NewBlock);
+
+    if(!GetUint32(&data, end, &num_words)) return false;
+    if(num_words != (bits ? (CHUNK_TOTAL * bits + CHUNK_WORD_BITS - 1) / CHUNK_WORD_BITS : 0)) return false;
+
+    std::vector<unsigned int> indices(num_words);
+    for(unsigned long i=0; i<num_words; ++i)
+    {
+        Uint32 word;
+        if(!GetUint32(&data, end, &word)) return false;
+        indices[i] = word;
+    }
+
+    // counts are not stored, rebuild them and check every index while at it
+    std::vector<unsigned long> counts(palette_size, 0);
+    if(bits == 0) counts[0] = CHUNK_TOTAL;
+    else
+    {
+        for(unsigned long i=0; i<CHUNK_TOTAL; ++i)
+        {
+            unsigned long bit = i * bits;
+            unsigned long index = (indices[bit / CHUNK_WORD_BITS] >> (bit % CHUNK_WORD_BITS)) & ((1u << bits) - 1);
+            if(index >= palette_size) return false;
+            ++counts[index];
+        }
+    }
+
+    this->palette.swap(palette);
+    this->palette_counts.swap(counts);
+    this->indices.swap(indices);
+    this->bits = bits;
+
+    this->num_solid = 0;
+    for(unsigned long p=0; p<palette_size; ++p)
+    {
+        if(this->palette[p].IsSolid()) this->num_solid += this->palette_counts[p];
+    }
+
+    return true;
+}
+
+void * Chunk::GetData(unsigned long x, unsigned long y, unsigned long z) const
+{
+    std::map<unsigned long, void *>::const_iterator i = this->extra.find(x + y * CHUNK_X + z * CHUNK_X * CHUNK_Y);
+    return i == this->extra.end() ? NULL : i->second;
+}
+
+void Chunk::SetData(unsigned long x, unsigned long y, unsigned long z, void *data)
+{
+    unsigned long i = x + y * CHUNK_X + z * CHUNK_X * CHUNK_Y;
+    if(data) this->extra[i] = data;
+    else this->extra.erase(i);
+}
+
+unsigned long ChunkStorage::GetMemoryUsage(void) const
+{
+    return sizeof(ChunkStorage) +
+           this->palette.capacity() * (sizeof(NewBlock) + sizeof(unsigned long)) +
+           this->indices.capacity() * sizeof(unsigned int);
+}
+
+unsigned long Chunk::GetMemoryUsage(void) const
+{
+    return sizeof(Chunk) + this->storage->GetMemoryUsage() +
+           this->extra.size() * (sizeof(unsigned long) + sizeof(void *));
+}
@@ -17,6 +17,12 @@
 #ifndef CHUNK_H
 #define CHUNK_H
 
+#include <stddef.h>
+#include <map>
+#include <vector>
+
+#include <SDL.h>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -31,39 +37,287 @@
 #define CHUNK_Z 32
 #define CHUNK_TOTAL (CHUNK_X * CHUNK_Y * CHUNK_Z)
 
+// chunk vertices are one attribute, see chunk.vsh
+#define CHUNK_ATTRIB_VERTEX 0
+
+/* one corner of a chunk mesh packed into 32 bits, low to high:
+ * x, y, z in blocks from the chunk origin (6 bits each, 0 to 32 inclusive),
+ * face (3 bits), ambient occlusion from 0 darkest to 3 open (2 bits), texture layer (9 bits)
+ */
+#define CHUNK_VERTEX_POSITION_BITS 6
+#define CHUNK_VERTEX_FACE_SHIFT 18
+#define CHUNK_VERTEX_AO_SHIFT 21
+#define CHUNK_VERTEX_LAYER_SHIFT 23
+#define CHUNK_VERTEX_MAX_LAYER 511
+
+struct ChunkVertex
+{
+    GLuint data;
+
+    inline ChunkVertex(unsigned int x, unsigned int y, unsigned int z, unsigned int face, unsigned int ao,
+                       unsigned int layer)
+    {
+        if(layer > CHUNK_VERTEX_MAX_LAYER) layer = CHUNK_VERTEX_MAX_LAYER;
+
+        this->data = x | (y << CHUNK_VERTEX_POSITION_BITS) | (z << (2 * CHUNK_VERTEX_POSITION_BITS)) |
+                     (face << CHUNK_VERTEX_FACE_SHIFT) | (ao << CHUNK_VERTEX_AO_SHIFT) |
+                     (layer << CHUNK_VERTEX_LAYER_SHIFT);
+    }
+};
+
+// chunks by coordinate in a sorted container, 21 bits per axis
+static inline Uint64 ChunkKey(int x, int y, int z)
+{
+    return ((Uint64)(x & 0x1fffff) << 42) | ((Uint64)(y & 0x1fffff) << 21) | (Uint64)(z & 0x1fffff);
+}
+
+// rounds towards negative infinity, for block to chunk and chunk to region coordinates
+static inline int FloorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// bits per palette index, entries never straddle a word
+#define CHUNK_WORD_BITS 32
+
+/* the blocks of a chunk, shared between the chunk and any mesh jobs reading it
+ * a chunk copies its storage before writing while a job still holds a reference
+ */
+class ChunkStorage : Object<ChunkStorage>
+{
+protected:
+    /* every distinct block state in the chunk, indexed by bit-packed indices
+     * of 0, 1, 2, 4, 8 or 16 bits, a uniform chunk is one entry and no indices
+     */
+    std::vector<NewBlock> palette;
+    std::vector<unsigned long> palette_counts;
+    std::vector<unsigned int> indices;
+    unsigned int bits;
+
+    unsigned long num_solid;
+
+    mutable SDL_atomic_t refs;
+
+    inline unsigned long GetIndex(unsigned long i) const
+    {
+        if(this->bits == 0) return 0;
+
+        unsigned long bit = i * this->bits;
+        return (this->indices[bit / CHUNK_WORD_BITS] >> (bit % CHUNK_WORD_BITS)) & ((1u << this->bits) - 1);
+    }
+
+    inline void SetIndex(unsigned long i, unsigned long index)
+    {
+        unsigned long bit = i * this->bits;
+        unsigned int mask = ((1u << this->bits) - 1) << (bit % CHUNK_WORD_BITS);
+        unsigned int &word = this->indices[bit / CHUNK_WORD_BITS];
+        word = (word & ~mask) | ((index << (bit % CHUNK_WORD_BITS)) & mask);
+    }
+
+    // repacks every index at a new width
+    void Repack(unsigned int bits);
+
+    // palette slot holding state, adding it if needed
+    unsigned long FindOrAdd(const NewBlock &state);
+public:
+    ChunkStorage() : bits(0), num_solid(0)
+    {
+        this->palette.push_back(NewBlock());
+        this->palette_counts.push_back(CHUNK_TOTAL);
+        SDL_AtomicSet(&this->refs, 1);
+    }
+
+    // a private copy with a single reference
+    ChunkStorage(const ChunkStorage &other) : palette(other.palette), palette_counts(other.palette_counts),
+                                              indices(other.indices), bits(other.bits), num_solid(other.num_solid)
+    {
+        SDL_AtomicSet(&this->refs, 1);
+    }
+
+    inline const ChunkStorage * Acquire(void) const
+    {
+        SDL_AtomicIncRef(&this->refs);
+        return this;
+    }
+
+    // drops a reference from any thread, the last one deletes the storage
+    static inline void Release(const ChunkStorage *storage)
+    {
+        if(storage && SDL_AtomicDecRef(&storage->refs)) delete storage;
+    }
+
+    inline bool IsShared(void) const { return SDL_AtomicGet(&this->refs) > 1; }
+
+    inline const NewBlock * Get(unsigned long i) const
+    {
+        return &this->palette[this->GetIndex(i)];
+    }
+
+    inline const NewBlock * Get(unsigned long x, unsigned long y, unsigned long z) const
+    {
+        return Get(x + y * CHUNK_X + z * CHUNK_X * CHUNK_Y);
+    }
+
+    inline unsigned short GetType(unsigned long x, unsigned long y, unsigned long z) const
+    {
+        return Get(x, y, z)->GetType();
+    }
+
+    void Set(unsigned long i, const NewBlock &state);
+
+    // writes the type of every block, in Get order
+    void Unpack(unsigned short *types) const;
+
+    // replaces every block with one of types, in Get order, building the palette in one pass
+    void Pack(const unsigned short *types);
+
+    inline bool IsEmpty(void) const { return this->num_solid == 0; }
+    inline bool IsUniform(void) const { return this->bits == 0; }
+    inline unsigned int GetBits(void) const { return this->bits; }
+
+    // bytes held by the block storage
+    unsigned long GetMemoryUsage(void) const;
+
+    /* appends the blocks as stored in region files: bits, palette size, raw palette entries,
+     * index word count and the index words, integers little-endian
+     */
+    void Serialize(std::vector<unsigned char> *out) const;
+
+    // replaces the blocks with serialized data, returns false and leaves them alone if it is malformed
+    bool Deserialize(const unsigned char *data, unsigned long len);
+};
+
 class Chunk : Object<Chunk>
 {
 protected:
-    NewBlock *blocks;
+    ChunkStorage *storage;
+
+    // per-block extra data, only for the few blocks that have any
+    std::map<unsigned long, void *> extra;
+
+    // position of the first block, in blocks
     glm::vec3 position;
+
+    GLuint vao;
+    GLuint vbo;
+    GLsizei num_vertices;
 public:
-    Chunk(glm::vec3 position = glm::vec3(0.0)) : position(position)
+    // changed since its last mesh job was queued
+    bool b_dirty;
+
+    // changed since it was last written to its region file
+    bool b_modified;
+
+    // ticket of the uploaded mesh, results of older jobs are dropped
+    unsigned long mesh_uploaded;
+
+    // last frame the chunk was within the view radius, for eviction
+    unsigned long last_used;
+
+    // takes over storage, or starts empty without one
+    Chunk(glm::vec3 position = glm::vec3(0.0), ChunkStorage *storage = NULL)
+        : storage(storage ? storage : new ChunkStorage), position(position), vao(0), vbo(0), num_vertices(0),
+          b_dirty(false), b_modified(false), mesh_uploaded(0), last_used(0) {}
+
+    ~Chunk()
     {
-        this->blocks = new NewBlock[CHUNK_TOTAL];
+        ChunkStorage::Release(this->storage);
+
+        if(this->vao)
+        {
+            glDeleteBuffers(1, &this->vbo);
+            glDeleteVertexArrays(1, &this->vao);
+        }
     }
 
-    ~Chunk()
+    inline const NewBlock * Get(unsigned long x, unsigned long y, unsigned long z) const
     {
-        delete[] blocks;
+        return this->storage->Get(x, y, z);
     }
 
-    inline NewBlock * Get(unsigned long i) const
+    inline unsigned short GetType(unsigned long x, unsigned long y, unsigned long z) const
     {
-        return &this->blocks[i];
+        return this->storage->GetType(x, y, z);
     }
 
-    inline NewBlock * Get(unsigned long x, unsigned long y, unsigned long z) const
+    inline void Set(unsigned long x, unsigned long y, unsigned long z, const NewBlock &state)
     {
-        return Get(x + y * CHUNK_X + z * CHUNK_X * CHUNK_Y);
+        // a mesh job may still be reading the current blocks
+        if(this->storage->IsShared())
+        {
+            ChunkStorage *copy = new ChunkStorage(*this->storage);
+            ChunkStorage::Release(this->storage);
+            this->storage = copy;
+        }
+
+        this->storage->Set(x + y * CHUNK_X + z * CHUNK_X * CHUNK_Y, state);
+        this->b_dirty = true;
+        this->b_modified = true;
+    }
+
+    inline void SetType(unsigned long x, unsigned long y, unsigned long z, unsigned short type)
+    {
+        Set(x, y, z, NewBlock(type));
     }
 
+    // a read-only reference to the blocks as they are now, Release it when done
+    inline const ChunkStorage * Snapshot(void) const { return this->storage->Acquire(); }
+
+    void * GetData(unsigned long x, unsigned long y, unsigned long z) const;
+    void SetData(unsigned long x, unsigned long y, unsigned long z, void *data);
+
+    inline bool IsEmpty(void) const { return this->storage->IsEmpty(); }
+
+    // bytes held by the chunk and its block storage
+    unsigned long GetMemoryUsage(void) const;
+
+    inline glm::vec3 GetPosition(void) const { return this->position; }
+    inline void SetPosition(glm::vec3 position) { this->position = position; }
+
+    inline GLsizei GetVertexCount(void) const { return this->num_vertices; }
+
     inline bool Init(void)
     {
+        glGenVertexArrays(1, &this->vao);
+        glBindVertexArray(this->vao);
+
+        glGenBuffers(1, &this->vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+
+        glVertexAttribIPointer(CHUNK_ATTRIB_VERTEX, 1, GL_UNSIGNED_INT, sizeof(ChunkVertex),
+                               (const GLvoid *)offsetof(ChunkVertex, data));
+        glEnableVertexAttribArray(CHUNK_ATTRIB_VERTEX);
+
         return true;
     }
 
-    inline bool Draw(void)
+    // replaces the mesh, the vertices can be freed afterwards
+    inline void Upload(const std::vector<ChunkVertex> &vertices)
+    {
+        this->num_vertices = vertices.size();
+
+        // most streamed chunks are empty, they never get GL objects
+        if(!this->vao)
+        {
+            if(vertices.empty()) return;
+            this->Init();
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(ChunkVertex),
+                     vertices.empty() ? NULL : &vertices[0], GL_STATIC_DRAW);
+    }
+
+    inline bool Draw(GLint u_vChunkOrigin)
     {
+        if(this->num_vertices == 0) return true;
+
+        // the shader adds the origin to the packed corners, both in blocks
+        glUniform3i(u_vChunkOrigin, this->position.x, this->position.y, this->position.z);
+
+        glBindVertexArray(this->vao);
+        glDrawArrays(GL_TRIANGLES, 0, this->num_vertices);
+
         return true;
     }
 };
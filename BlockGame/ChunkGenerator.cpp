@@ -0,0 +1,505 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "ChunkGenerator.h"
+
+// widest instruction set the compiler was allowed to use, build with -mavx2 for 8 lanes
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GEN_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GEN_SIMD_WIDTH 4
+#else
+#define GEN_SIMD_WIDTH 1
+#endif
+
+// lattice hashing, one odd constant per axis
+#define GEN_PRIME_X 0x8da6b343u
+#define GEN_PRIME_Y 0xd8163841u
+#define GEN_PRIME_Z 0xcb1ab31fu
+
+// keep the noise fields of one seed apart
+#define GEN_OCTAVE_SALT 0x9e3779b9u
+#define GEN_BIOME_SALT 0x68bc21ebu
+#define GEN_CAVE_SALT 0x02e5be93u
+
+// noise frequencies in cycles per block
+#define GEN_HEIGHT_SCALE (1.0f / 128.0f)
+#define GEN_BIOME_SCALE (1.0f / 512.0f)
+#define GEN_CAVE_SCALE (1.0f / 32.0f)
+#define GEN_CAVE_SCALE_Y (1.0f / 20.0f)
+
+// caves are carved where their density is above this
+#define GEN_CAVE_THRESHOLD 0.3f
+
+// biome noise below this is desert
+#define GEN_DESERT_THRESHOLD -0.2f
+
+/* lane helpers so the noise is written once for every width
+ * integers are 32 bits and wrap, masks are all ones or all zeros per lane
+ */
+#if GEN_SIMD_WIDTH == 8
+typedef __m256 vfloat;
+typedef __m256i vint;
+
+static inline vfloat VSet(float f) { return _mm256_set1_ps(f); }
+static inline vint VSetI(Uint32 i) { return _mm256_set1_epi32(i); }
+static inline vfloat VLoad(const float *p) { return _mm256_loadu_ps(p); }
+static inline void VStore(float *p, vfloat a) { _mm256_storeu_ps(p, a); }
+static inline vfloat VAdd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+static inline vfloat VSub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+static inline vfloat VMul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+static inline vfloat VFloor(vfloat a) { return _mm256_floor_ps(a); }
+static inline vint VToInt(vfloat a) { return _mm256_cvttps_epi32(a); }
+static inline vint VAddI(vint a, vint b) { return _mm256_add_epi32(a, b); }
+static inline vint VMulI(vint a, vint b) { return _mm256_mullo_epi32(a, b); }
+static inline vint VXorI(vint a, vint b) { return _mm256_xor_si256(a, b); }
+static inline vint VAndI(vint a, vint b) { return _mm256_and_si256(a, b); }
+static inline vint VSrlI(vint a, int n) { return _mm256_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+static inline vint VSllI(vint a, int n) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+static inline vint VCmpEqI(vint a, vint b) { return _mm256_cmpeq_epi32(a, b); }
+static inline vfloat VSelect(vint mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(mask)); }
+static inline vfloat VXorBits(vfloat a, vint bits) { return _mm256_xor_ps(a, _mm256_castsi256_ps(bits)); }
+#elif GEN_SIMD_WIDTH == 4
+typedef __m128 vfloat;
+typedef __m128i vint;
+
+static inline vfloat VSet(float f) { return _mm_set1_ps(f); }
+static inline vint VSetI(Uint32 i) { return _mm_set1_epi32(i); }
+static inline vfloat VLoad(const float *p) { return _mm_loadu_ps(p); }
+static inline void VStore(float *p, vfloat a) { _mm_storeu_ps(p, a); }
+static inline vfloat VAdd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+static inline vfloat VSub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+static inline vfloat VMul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+static inline vint VToInt(vfloat a) { return _mm_cvttps_epi32(a); }
+static inline vint VAddI(vint a, vint b) { return _mm_add_epi32(a, b); }
+static inline vint VXorI(vint a, vint b) { return _mm_xor_si128(a, b); }
+static inline vint VAndI(vint a, vint b) { return _mm_and_si128(a, b); }
+static inline vint VSrlI(vint a, int n) { return _mm_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+static inline vint VSllI(vint a, int n) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+static inline vint VCmpEqI(vint a, vint b) { return _mm_cmpeq_epi32(a, b); }
+static inline vfloat VXorBits(vfloat a, vint bits) { return _mm_xor_ps(a, _mm_castsi128_ps(bits)); }
+
+static inline vfloat VFloor(vfloat a)
+{
+    // truncation rounds negative values up, step those back down
+    vfloat t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmplt_ps(a, t), _mm_set1_ps(1.0f)));
+}
+
+static inline vint VMulI(vint a, vint b)
+{
+    // no 32 bit low multiply before SSE4.1, multiply even and odd lanes and interleave the low halves
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline vfloat VSelect(vint mask, vfloat a, vfloat b)
+{
+    vfloat m = _mm_castsi128_ps(mask);
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+#else
+typedef float vfloat;
+typedef Uint32 vint;
+
+static inline vfloat VSet(float f) { return f; }
+static inline vint VSetI(Uint32 i) { return i; }
+static inline vfloat VLoad(const float *p) { return *p; }
+static inline void VStore(float *p, vfloat a) { *p = a; }
+static inline vfloat VAdd(vfloat a, vfloat b) { return a + b; }
+static inline vfloat VSub(vfloat a, vfloat b) { return a - b; }
+static inline vfloat VMul(vfloat a, vfloat b) { return a * b; }
+static inline vfloat VFloor(vfloat a) { return floorf(a); }
+static inline vint VToInt(vfloat a) { return (Uint32)(Sint32)a; }
+static inline vint VAddI(vint a, vint b) { return a + b; }
+static inline vint VMulI(vint a, vint b) { return a * b; }
+static inline vint VXorI(vint a, vint b) { return a ^ b; }
+static inline vint VAndI(vint a, vint b) { return a & b; }
+static inline vint VSrlI(vint a, int n) { return a >> n; }
+static inline vint VSllI(vint a, int n) { return a << n; }
+static inline vint VCmpEqI(vint a, vint b) { return a == b ? 0xffffffffu : 0; }
+static inline vfloat VSelect(vint mask, vfloat a, vfloat b) { return mask ? a : b; }
+
+static inline vfloat VXorBits(vfloat a, vint bits)
+{
+    Uint32 u;
+    memcpy(&u, &a, sizeof(u));
+    u ^= bits;
+    memcpy(&a, &u, sizeof(u));
+    return a;
+}
+#endif
+
+// block offsets of the lanes along x
+static const float lane_offsets[8] = { 0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f };
+
+static inline vfloat Fade(vfloat t)
+{
+    // 6t^5 - 15t^4 + 10t^3
+    vfloat inner = VAdd(VMul(t, VSub(VMul(t, VSet(6.0f)), VSet(15.0f))), VSet(10.0f));
+    return VMul(VMul(VMul(t, t), t), inner);
+}
+
+static inline vfloat Lerp(vfloat t, vfloat a, vfloat b)
+{
+    return VAdd(a, VMul(t, VSub(b, a)));
+}
+
+// dot product of a hashed gradient along two axes with the offset from its lattice point
+static inline vfloat Gradient(vint seed, vint hx, vint hy, vint hz, vfloat x, vfloat y, vfloat z)
+{
+    vint h = VXorI(VXorI(seed, hx), VXorI(hy, hz));
+    h = VMulI(VXorI(h, VSrlI(h, 16)), VSetI(0x7feb352du));
+    h = VMulI(VXorI(h, VSrlI(h, 15)), VSetI(0x846ca68bu));
+    h = VXorI(h, VSrlI(h, 16));
+
+    vint b8 = VCmpEqI(VAndI(h, VSetI(8)), VSetI(8));
+    vint b4 = VCmpEqI(VAndI(h, VSetI(4)), VSetI(4));
+    vfloat u = VSelect(b8, y, x);
+    vfloat v = VSelect(b4, z, VSelect(b8, x, y));
+
+    // bits 0 and 1 flip the signs
+    u = VXorBits(u, VSllI(VAndI(h, VSetI(1)), 31));
+    v = VXorBits(v, VSllI(VAndI(h, VSetI(2)), 30));
+    return VAdd(u, v);
+}
+
+// 3D gradient noise, roughly -1 to 1
+static vfloat Noise(vfloat x, vfloat y, vfloat z, vint seed)
+{
+    vfloat fx = VFloor(x), fy = VFloor(y), fz = VFloor(z);
+    vfloat dx = VSub(x, fx), dy = VSub(y, fy), dz = VSub(z, fz);
+    vfloat ex = VSub(dx, VSet(1.0f)), ey = VSub(dy, VSet(1.0f)), ez = VSub(dz, VSet(1.0f));
+
+    // the next lattice point along an axis is one prime further
+    vint hx0 = VMulI(VToInt(fx), VSetI(GEN_PRIME_X)), hx1 = VAddI(hx0, VSetI(GEN_PRIME_X));
+    vint hy0 = VMulI(VToInt(fy), VSetI(GEN_PRIME_Y)), hy1 = VAddI(hy0, VSetI(GEN_PRIME_Y));
+    vint hz0 = VMulI(VToInt(fz), VSetI(GEN_PRIME_Z)), hz1 = VAddI(hz0, VSetI(GEN_PRIME_Z));
+
+    vfloat n000 = Gradient(seed, hx0, hy0, hz0, dx, dy, dz);
+    vfloat n100 = Gradient(seed, hx1, hy0, hz0, ex, dy, dz);
+    vfloat n010 = Gradient(seed, hx0, hy1, hz0, dx, ey, dz);
+    vfloat n110 = Gradient(seed, hx1, hy1, hz0, ex, ey, dz);
+    vfloat n001 = Gradient(seed, hx0, hy0, hz1, dx, dy, ez);
+    vfloat n101 = Gradient(seed, hx1, hy0, hz1, ex, dy, ez);
+    vfloat n011 = Gradient(seed, hx0, hy1, hz1, dx, ey, ez);
+    vfloat n111 = Gradient(seed, hx1, hy1, hz1, ex, ey, ez);
+
+    vfloat u = Fade(dx), v = Fade(dy), w = Fade(dz);
+    return Lerp(w, Lerp(v, Lerp(u, n000, n100), Lerp(u, n010, n110)),
+                   Lerp(v, Lerp(u, n001, n101), Lerp(u, n011, n111)));
+}
+
+// octaves of noise at doubling frequency and halving amplitude, scaled back to one
+static vfloat Fractal(vfloat x, vfloat y, vfloat z, Uint32 seed, int octaves)
+{
+    vfloat sum = VSet(0.0f);
+    float amplitude = 1.0f, total = 0.0f, frequency = 1.0f;
+
+    for(int o=0; o<octaves; ++o)
+    {
+        vfloat f = VSet(frequency);
+        vfloat n = Noise(VMul(x, f), VMul(y, f), VMul(z, f), VSetI(seed + o * GEN_OCTAVE_SALT));
+        sum = VAdd(sum, VMul(n, VSet(amplitude)));
+
+        total += amplitude;
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+
+    return VMul(sum, VSet(1.0f / total));
+}
+
+void ChunkGenerator::Generate(Uint32 seed, int x, int y, int z, unsigned short *types)
+{
+    int ox = x * CHUNK_X, oy = y * CHUNK_Y, oz = z * CHUNK_Z;
+    vfloat lanes = VLoad(lane_offsets);
+
+    // one height and biome per column, CHUNK_X is a multiple of every width
+    int heights[CHUNK_X * CHUNK_Z];
+    bool deserts[CHUNK_X * CHUNK_Z];
+    int max_height = oy - 1;
+
+    for(int bz=0; bz<CHUNK_Z; ++bz)
+    {
+        float height[CHUNK_X], biome[CHUNK_X];
+        vfloat vz = VSet(oz + bz);
+
+        for(int bx=0; bx<CHUNK_X; bx+=GEN_SIMD_WIDTH)
+        {
+            vfloat vx = VAdd(VSet(ox + bx), lanes);
+            VStore(&height[bx], Fractal(VMul(vx, VSet(GEN_HEIGHT_SCALE)), VSet(0.0f),
+                                        VMul(vz, VSet(GEN_HEIGHT_SCALE)), seed, 4));
+            VStore(&biome[bx], Noise(VMul(vx, VSet(GEN_BIOME_SCALE)), VSet(0.5f),
+                                     VMul(vz, VSet(GEN_BIOME_SCALE)), VSetI(seed ^ GEN_BIOME_SALT)));
+        }
+
+        for(int bx=0; bx<CHUNK_X; ++bx)
+        {
+            int h = GEN_BASE_HEIGHT + (int)floorf(height[bx] * GEN_HEIGHT_RANGE);
+            heights[bx + bz * CHUNK_X] = h;
+            deserts[bx + bz * CHUNK_X] = biome[bx] < GEN_DESERT_THRESHOLD;
+            if(h > max_height) max_height = h;
+        }
+    }
+
+    for(int bz=0; bz<CHUNK_Z; ++bz)
+    {
+        vfloat vz = VMul(VSet(oz + bz), VSet(GEN_CAVE_SCALE));
+
+        for(int by=0; by<CHUNK_Y; ++by)
+        {
+            unsigned short *row = &types[by * CHUNK_X + bz * CHUNK_X * CHUNK_Y];
+            int wy = oy + by;
+
+            // open sky needs no cave noise
+            if(wy > max_height)
+            {
+                for(int bx=0; bx<CHUNK_X; ++bx) row[bx] = BLOCK_TYPE_AIR;
+                continue;
+            }
+
+            float cave[CHUNK_X];
+            vfloat vy = VSet(wy * GEN_CAVE_SCALE_Y);
+            for(int bx=0; bx<CHUNK_X; bx+=GEN_SIMD_WIDTH)
+            {
+                vfloat vx = VMul(VAdd(VSet(ox + bx), lanes), VSet(GEN_CAVE_SCALE));
+                VStore(&cave[bx], Fractal(vx, vy, vz, seed ^ GEN_CAVE_SALT, 2));
+            }
+
+            for(int bx=0; bx<CHUNK_X; ++bx)
+            {
+                int depth = heights[bx + bz * CHUNK_X] - wy;
+                bool desert = deserts[bx + bz * CHUNK_X];
+
+                if(depth < 0 || cave[bx] > GEN_CAVE_THRESHOLD) row[bx] = BLOCK_TYPE_AIR;
+                else if(depth == 0)
+                {
+                    if(wy > GEN_SNOW_LINE) row[bx] = BLOCK_TYPE_SNOW;
+                    else row[bx] = desert ? BLOCK_TYPE_SAND : BLOCK_TYPE_GRASS;
+                }
+                else if(depth <= GEN_SOIL_DEPTH) row[bx] = desert ? BLOCK_TYPE_SAND : BLOCK_TYPE_DIRT;
+                else row[bx] = BLOCK_TYPE_STONE;
+            }
+        }
+    }
+}
+
+bool ChunkGenerator::Init(Uint32 seed)
+{
+    this->seed = seed;
+
+    this->lock = SDL_CreateMutex();
+    this->wake = SDL_CreateCond();
+    if(!this->lock || !this->wake)
+    {
+        fprintf(stderr, "ChunkGenerator::Init: error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    int count = SDL_GetCPUCount() - 1;
+    if(count < 1) count = 1;
+    if(count > GEN_MAX_WORKERS) count = GEN_MAX_WORKERS;
+
+    for(this->num_workers=0; this->num_workers<count; ++this->num_workers)
+    {
+        this->workers[this->num_workers] = SDL_CreateThread(WorkerMain, "generator", this);
+        if(!this->workers[this->num_workers])
+        {
+            fprintf(stderr, "ChunkGenerator::Init: error: %s\n", SDL_GetError());
+            break;
+        }
+    }
+
+    return this->num_workers > 0;
+}
+
+void ChunkGenerator::Destroy(void)
+{
+    if(this->lock)
+    {
+        SDL_LockMutex(this->lock);
+        this->b_quit = true;
+        SDL_CondBroadcast(this->wake);
+        SDL_UnlockMutex(this->lock);
+    }
+
+    for(int i=0; i<this->num_workers; ++i) SDL_WaitThread(this->workers[i], NULL);
+    this->num_workers = 0;
+    this->jobs.clear();
+
+    for(ChunkGenerateResult *r=this->Poll(), *next; r; r=next)
+    {
+        next = r->next;
+        ChunkStorage::Release(r->storage);
+        delete r;
+    }
+
+    if(this->wake) SDL_DestroyCond(this->wake);
+    if(this->lock) SDL_DestroyMutex(this->lock);
+    this->wake = NULL;
+    this->lock = NULL;
+}
+
+int ChunkGenerator::WorkerMain(void *data)
+{
+    ((ChunkGenerator *)data)->Work();
+    return 0;
+}
+
+void ChunkGenerator::Work(void)
+{
+    std::vector<unsigned short> types(CHUNK_TOTAL);
+    Uint64 ticks = 0;
+
+    SDL_LockMutex(this->lock);
+    for(;;)
+    {
+        // account for the previous chunk while holding the lock anyway
+        if(ticks)
+        {
+            --this->num_active;
+            ++this->batch_chunks;
+            this->batch_ticks += ticks;
+            ticks = 0;
+
+            if(this->jobs.empty() && this->num_active == 0)
+            {
+                double frequency = SDL_GetPerformanceFrequency();
+                this->report.chunks = this->batch_chunks;
+                this->report.seconds = (SDL_GetPerformanceCounter() - this->batch_start) / frequency;
+                this->report.busy_seconds = this->batch_ticks / frequency;
+                this->b_report = true;
+            }
+        }
+
+        while(!this->b_quit && this->jobs.empty()) SDL_CondWait(this->wake, this->lock);
+
+        if(this->b_quit)
+        {
+            SDL_UnlockMutex(this->lock);
+            return;
+        }
+
+        std::pop_heap(this->jobs.begin(), this->jobs.end(), Nearer);
+        ChunkGenerateJob job = this->jobs.back();
+        this->jobs.pop_back();
+        ++this->num_active;
+        SDL_UnlockMutex(this->lock);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        ChunkGenerateResult *result = new ChunkGenerateResult;
+        result->x = job.x;
+        result->y = job.y;
+        result->z = job.z;
+
+        Generate(this->seed, job.x, job.y, job.z, &types[0]);
+        result->storage = new ChunkStorage;
+        result->storage->Pack(&types[0]);
+
+        // push onto the results stack, Poll takes the whole stack so there is no ABA
+        void *head;
+        do
+        {
+            head = SDL_AtomicGetPtr(&this->results);
+            result->next = (ChunkGenerateResult *)head;
+        } while(!SDL_AtomicCASPtr(&this->results, head, result));
+
+        ticks = SDL_GetPerformanceCounter() - start;
+        if(ticks == 0) ticks = 1;
+
+        SDL_LockMutex(this->lock);
+    }
+}
+
+void ChunkGenerator::Submit(int x, int y, int z, float priority)
+{
+    ChunkGenerateJob job;
+    job.x = x;
+    job.y = y;
+    job.z = z;
+    job.priority = priority;
+
+    SDL_LockMutex(this->lock);
+
+    // the first job into an idle generator starts a batch
+    if(this->jobs.empty() && this->num_active == 0)
+    {
+        this->batch_start = SDL_GetPerformanceCounter();
+        this->batch_ticks = 0;
+        this->batch_chunks = 0;
+    }
+
+    this->jobs.push_back(job);
+    std::push_heap(this->jobs.begin(), this->jobs.end(), Nearer);
+
+    SDL_CondSignal(this->wake);
+    SDL_UnlockMutex(this->lock);
+}
+
+void ChunkGenerator::Prioritise(const glm::vec3 &position)
+{
+    SDL_LockMutex(this->lock);
+
+    for(std::vector<ChunkGenerateJob>::iterator i=this->jobs.begin(); i!=this->jobs.end(); ++i)
+    {
+        glm::vec3 centre = glm::vec3(i->x * CHUNK_X, i->y * CHUNK_Y, i->z * CHUNK_Z) +
+                           glm::vec3(CHUNK_X, CHUNK_Y, CHUNK_Z) * 0.5f - position;
+        i->priority = glm::dot(centre, centre);
+    }
+    std::make_heap(this->jobs.begin(), this->jobs.end(), Nearer);
+
+    SDL_UnlockMutex(this->lock);
+}
+
+ChunkGenerateResult * ChunkGenerator::Poll(void)
+{
+    ChunkGenerateResult *head = (ChunkGenerateResult *)SDL_AtomicSetPtr(&this->results, NULL);
+
+    // the stack is newest first
+    ChunkGenerateResult *ordered = NULL;
+    while(head)
+    {
+        ChunkGenerateResult *next = head->next;
+        head->next = ordered;
+        ordered = head;
+        head = next;
+    }
+
+    return ordered;
+}
+
+bool ChunkGenerator::TakeReport(ChunkGenerateReport *report)
+{
+    SDL_LockMutex(this->lock);
+
+    bool b_report = this->b_report;
+    if(b_report) *report = this->report;
+    this->b_report = false;
+
+    SDL_UnlockMutex(this->lock);
+    return b_report;
+}
@@ -0,0 +1,127 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CHUNKGENERATOR_H
+#define CHUNKGENERATOR_H
+
+#include <vector>
+
+#include <SDL.h>
+
+#include "Chunk.h"
+
+#define GEN_MAX_WORKERS 16
+#define GEN_DEFAULT_SEED 1337
+
+// terrain height in blocks is GEN_BASE_HEIGHT plus up to GEN_HEIGHT_RANGE either way
+#define GEN_BASE_HEIGHT 0
+#define GEN_HEIGHT_RANGE 48
+
+// surfaces above this are snow whatever the biome
+#define GEN_SNOW_LINE 20
+
+// soil between the surface and the stone
+#define GEN_SOIL_DEPTH 3
+
+struct ChunkGenerateJob
+{
+    int x, y, z;
+
+    // squared distance to the camera, nearest first
+    float priority;
+};
+
+// a generated chunk, linked into the results stack
+struct ChunkGenerateResult
+{
+    int x, y, z;
+
+    // owned by whoever takes the result
+    ChunkStorage *storage;
+
+    ChunkGenerateResult *next;
+};
+
+// throughput of one batch, from the first job into an idle generator until it is idle again
+struct ChunkGenerateReport
+{
+    unsigned long chunks;
+
+    // wall clock time and time summed over the workers, in seconds
+    double seconds;
+    double busy_seconds;
+};
+
+/* fills chunks with terrain on worker threads
+ * the blocks depend only on the seed and the chunk coordinate, so a chunk that was never
+ * saved comes out the same every time it is generated
+ */
+class ChunkGenerator : Object<ChunkGenerator>
+{
+protected:
+    SDL_Thread *workers[GEN_MAX_WORKERS];
+    int num_workers;
+
+    Uint32 seed;
+
+    // pending jobs as a heap on priority, guarded by lock
+    std::vector<ChunkGenerateJob> jobs;
+    SDL_mutex *lock;
+    SDL_cond *wake;
+    bool b_quit;
+
+    // jobs being generated, and the running batch, guarded by lock
+    int num_active;
+    Uint64 batch_start;
+    Uint64 batch_ticks;
+    unsigned long batch_chunks;
+    ChunkGenerateReport report;
+    bool b_report;
+
+    // finished chunks pushed by any worker, taken all at once by Poll
+    void *results;
+
+    static bool Nearer(const ChunkGenerateJob &a, const ChunkGenerateJob &b) { return a.priority > b.priority; }
+    static int WorkerMain(void *data);
+
+    void Work(void);
+public:
+    ChunkGenerator() : num_workers(0), seed(GEN_DEFAULT_SEED), lock(NULL), wake(NULL), b_quit(false),
+                       num_active(0), batch_start(0), batch_ticks(0), batch_chunks(0), b_report(false),
+                       results(NULL) {}
+
+    // starts one worker per core but one
+    bool Init(Uint32 seed = GEN_DEFAULT_SEED);
+    void Destroy(void);
+
+    inline int GetWorkerCount(void) const { return this->num_workers; }
+
+    // writes the block types of a chunk in Chunk block order, callable from any thread
+    static void Generate(Uint32 seed, int x, int y, int z, unsigned short *types);
+
+    void Submit(int x, int y, int z, float priority);
+
+    // orders pending jobs by distance to position, in blocks
+    void Prioritise(const glm::vec3 &position);
+
+    // finished chunks oldest first, the caller deletes them
+    ChunkGenerateResult * Poll(void);
+
+    // true once for each finished batch
+    bool TakeReport(ChunkGenerateReport *report);
+};
+
+#endif
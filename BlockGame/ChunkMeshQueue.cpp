@@ -0,0 +1,184 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "ChunkMeshQueue.h"
+
+bool ChunkMeshQueue::Init(void)
+{
+    this->lock = SDL_CreateMutex();
+    this->wake = SDL_CreateCond();
+    if(!this->lock || !this->wake)
+    {
+        fprintf(stderr, "ChunkMeshQueue::Init: error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    int count = SDL_GetCPUCount() - 1;
+    if(count < 1) count = 1;
+    if(count > MESH_QUEUE_MAX_WORKERS) count = MESH_QUEUE_MAX_WORKERS;
+
+    for(this->num_workers=0; this->num_workers<count; ++this->num_workers)
+    {
+        this->workers[this->num_workers] = SDL_CreateThread(WorkerMain, "mesher", this);
+        if(!this->workers[this->num_workers])
+        {
+            fprintf(stderr, "ChunkMeshQueue::Init: error: %s\n", SDL_GetError());
+            break;
+        }
+    }
+
+    return this->num_workers > 0;
+}
+
+void ChunkMeshQueue::Destroy(void)
+{
+    if(this->lock)
+    {
+        SDL_LockMutex(this->lock);
+        this->b_quit = true;
+        SDL_CondBroadcast(this->wake);
+        SDL_UnlockMutex(this->lock);
+    }
+
+    for(int i=0; i<this->num_workers; ++i) SDL_WaitThread(this->workers[i], NULL);
+    this->num_workers = 0;
+
+    for(std::vector<ChunkMeshJob>::iterator i=this->jobs.begin(); i!=this->jobs.end(); ++i) ReleaseJob(&*i);
+    this->jobs.clear();
+
+    for(ChunkMeshResult *r=this->Poll(), *next; r; r=next)
+    {
+        next = r->next;
+        delete r;
+    }
+
+    if(this->wake) SDL_DestroyCond(this->wake);
+    if(this->lock) SDL_DestroyMutex(this->lock);
+    this->wake = NULL;
+    this->lock = NULL;
+}
+
+int ChunkMeshQueue::WorkerMain(void *data)
+{
+    ((ChunkMeshQueue *)data)->Work();
+    return 0;
+}
+
+void ChunkMeshQueue::ReleaseJob(ChunkMeshJob *job)
+{
+    ChunkStorage::Release(job->chunk);
+    for(int face=0; face<NUM_BLOCK_FACES; ++face) ChunkStorage::Release(job->neighbours[face]);
+}
+
+void ChunkMeshQueue::Work(void)
+{
+    for(;;)
+    {
+        SDL_LockMutex(this->lock);
+        while(!this->b_quit && this->jobs.empty()) SDL_CondWait(this->wake, this->lock);
+
+        if(this->b_quit)
+        {
+            SDL_UnlockMutex(this->lock);
+            return;
+        }
+
+        std::pop_heap(this->jobs.begin(), this->jobs.end(), Nearer);
+        ChunkMeshJob job = this->jobs.back();
+        this->jobs.pop_back();
+        SDL_UnlockMutex(this->lock);
+
+        ChunkMeshResult *result = new ChunkMeshResult;
+        result->x = job.x;
+        result->y = job.y;
+        result->z = job.z;
+        result->ticket = job.ticket;
+
+        ChunkMesher::Build(job.chunk, job.neighbours, &result->vertices, job.mode);
+        ReleaseJob(&job);
+
+        // push onto the results stack, Poll takes the whole stack so there is no ABA
+        void *head;
+        do
+        {
+            head = SDL_AtomicGetPtr(&this->results);
+            result->next = (ChunkMeshResult *)head;
+        } while(!SDL_AtomicCASPtr(&this->results, head, result));
+    }
+}
+
+void ChunkMeshQueue::Submit(const ChunkMeshJob &job)
+{
+    SDL_LockMutex(this->lock);
+
+    for(std::vector<ChunkMeshJob>::iterator i=this->jobs.begin(); i!=this->jobs.end(); ++i)
+    {
+        if(i->x == job.x && i->y == job.y && i->z == job.z)
+        {
+            ReleaseJob(&*i);
+            *i = job;
+
+            // the priority may have changed
+            std::make_heap(this->jobs.begin(), this->jobs.end(), Nearer);
+            SDL_UnlockMutex(this->lock);
+            return;
+        }
+    }
+
+    SDL_AtomicIncRef(&this->in_flight);
+    this->jobs.push_back(job);
+    std::push_heap(this->jobs.begin(), this->jobs.end(), Nearer);
+
+    SDL_CondSignal(this->wake);
+    SDL_UnlockMutex(this->lock);
+}
+
+void ChunkMeshQueue::Prioritise(const glm::vec3 &position)
+{
+    SDL_LockMutex(this->lock);
+
+    for(std::vector<ChunkMeshJob>::iterator i=this->jobs.begin(); i!=this->jobs.end(); ++i)
+    {
+        glm::vec3 centre = glm::vec3(i->x * CHUNK_X, i->y * CHUNK_Y, i->z * CHUNK_Z) +
+                           glm::vec3(CHUNK_X, CHUNK_Y, CHUNK_Z) * 0.5f - position;
+        i->priority = glm::dot(centre, centre);
+    }
+    std::make_heap(this->jobs.begin(), this->jobs.end(), Nearer);
+
+    SDL_UnlockMutex(this->lock);
+}
+
+ChunkMeshResult * ChunkMeshQueue::Poll(void)
+{
+    ChunkMeshResult *head = (ChunkMeshResult *)SDL_AtomicSetPtr(&this->results, NULL);
+
+    // the stack is newest first
+    ChunkMeshResult *ordered = NULL;
+    while(head)
+    {
+        ChunkMeshResult *next = head->next;
+        head->next = ordered;
+        ordered = head;
+        head = next;
+
+        SDL_AtomicAdd(&this->in_flight, -1);
+    }
+
+    return ordered;
+}
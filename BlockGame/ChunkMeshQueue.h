@@ -0,0 +1,103 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CHUNKMESHQUEUE_H
+#define CHUNKMESHQUEUE_H
+
+#include <vector>
+
+#include <SDL.h>
+
+#include "Chunk.h"
+#include "ChunkMesher.h"
+
+#define MESH_QUEUE_MAX_WORKERS 16
+
+// everything a worker needs to mesh one chunk without touching the live chunks
+struct ChunkMeshJob
+{
+    int x, y, z;
+    unsigned long ticket;
+    MesherMode mode;
+
+    // squared distance to the camera, nearest first
+    float priority;
+
+    // snapshots of the chunk and its neighbours in BlockFace order, released once meshed
+    const ChunkStorage *chunk;
+    const ChunkStorage *neighbours[NUM_BLOCK_FACES];
+};
+
+// a finished mesh waiting for the GL thread, linked into the results stack
+struct ChunkMeshResult
+{
+    int x, y, z;
+    unsigned long ticket;
+    std::vector<ChunkVertex> vertices;
+
+    ChunkMeshResult *next;
+};
+
+/* meshes chunks on worker threads
+ * the GL thread submits jobs and uploads results, workers only read snapshots
+ */
+class ChunkMeshQueue : Object<ChunkMeshQueue>
+{
+protected:
+    SDL_Thread *workers[MESH_QUEUE_MAX_WORKERS];
+    int num_workers;
+
+    // pending jobs as a heap on priority, guarded by lock
+    std::vector<ChunkMeshJob> jobs;
+    SDL_mutex *lock;
+    SDL_cond *wake;
+    bool b_quit;
+
+    // jobs submitted but not yet handed back by Poll
+    SDL_atomic_t in_flight;
+
+    // finished meshes pushed by any worker, taken all at once by the GL thread
+    void *results;
+
+    static bool Nearer(const ChunkMeshJob &a, const ChunkMeshJob &b) { return a.priority > b.priority; }
+    static int WorkerMain(void *data);
+
+    void Work(void);
+    static void ReleaseJob(ChunkMeshJob *job);
+public:
+    ChunkMeshQueue() : num_workers(0), lock(NULL), wake(NULL), b_quit(false), results(NULL)
+    {
+        SDL_AtomicSet(&this->in_flight, 0);
+    }
+
+    // starts one worker per core but one, the GL thread keeps the other
+    bool Init(void);
+    void Destroy(void);
+
+    inline int GetWorkerCount(void) const { return this->num_workers; }
+    inline bool IsIdle(void) { return SDL_AtomicGet(&this->in_flight) == 0; }
+
+    // queues a job, replacing any job for the same chunk that has not started yet
+    void Submit(const ChunkMeshJob &job);
+
+    // orders pending jobs by distance to position, in blocks
+    void Prioritise(const glm::vec3 &position);
+
+    // finished meshes oldest first, the caller deletes them
+    ChunkMeshResult * Poll(void);
+};
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ChunkMesher.h"
+
+const glm::i8vec4 ChunkMesher::normals[NUM_BLOCK_FACES] =
+{
+    glm::i8vec4(-1,  0,  0, 0),
+    glm::i8vec4( 1,  0,  0, 0),
+    glm::i8vec4( 0, -1,  0, 0),
+    glm::i8vec4( 0,  1,  0, 0),
+    glm::i8vec4( 0,  0, -1, 0),
+    glm::i8vec4( 0,  0,  1, 0),
+};
+
+const glm::i8vec4 ChunkMesher::corners[NUM_BLOCK_FACES][4] =
+{
+    // left
+    { glm::i8vec4(0, 0, 0, 0), glm::i8vec4(0, 0, 1, 0), glm::i8vec4(0, 1, 1, 0), glm::i8vec4(0, 1, 0, 0) },
+    // right
+    { glm::i8vec4(1, 0, 0, 0), glm::i8vec4(1, 1, 0, 0), glm::i8vec4(1, 1, 1, 0), glm::i8vec4(1, 0, 1, 0) },
+    // bottom
+    { glm::i8vec4(0, 0, 0, 0), glm::i8vec4(1, 0, 0, 0), glm::i8vec4(1, 0, 1, 0), glm::i8vec4(0, 0, 1, 0) },
+    // top
+    { glm::i8vec4(0, 1, 0, 0), glm::i8vec4(0, 1, 1, 0), glm::i8vec4(1, 1, 1, 0), glm::i8vec4(1, 1, 0, 0) },
+    // front
+    { glm::i8vec4(0, 0, 0, 0), glm::i8vec4(0, 1, 0, 0), glm::i8vec4(1, 1, 0, 0), glm::i8vec4(1, 0, 0, 0) },
+    // back
+    { glm::i8vec4(0, 0, 1, 0), glm::i8vec4(1, 0, 1, 0), glm::i8vec4(1, 1, 1, 0), glm::i8vec4(0, 1, 1, 0) },
+};
+
+// index into the padded type grid, which has a one block border on every side
+static inline int Padded(int x, int y, int z)
+{
+    return (x + 1) + (y + 1) * MESHER_PAD_X + (z + 1) * MESHER_PAD_X * MESHER_PAD_Y;
+}
+
+const char *ChunkMesher::mode_names[NUM_MESHER_MODES] =
+{
+    "simple",
+    "greedy",
+};
+
+void ChunkMesher::EmitQuad(std::vector<ChunkVertex> *vertices, int face, const int *origin, int w, int h,
+                           unsigned short type, unsigned int ao)
+{
+    // two triangles per quad, split along the brighter diagonal so occlusion interpolates evenly
+    static const int order[2][6] = {{0, 1, 2, 0, 2, 3}, {1, 2, 3, 1, 3, 0}};
+    unsigned int ao0 = ao & 3, ao1 = (ao >> 2) & 3, ao2 = (ao >> 4) & 3, ao3 = (ao >> 6) & 3;
+    const int *split = order[ao0 + ao2 < ao1 + ao3];
+
+    // the face lies across axes u and v, the normal is along d
+    int d = face / 2;
+    int u = (d + 1) % 3;
+    int v = (d + 2) % 3;
+
+    for(int i=0; i<6; ++i)
+    {
+        const glm::i8vec4 &corner = corners[face][split[i]];
+
+        int position[3];
+        position[d] = origin[d] + corner[d];
+        position[u] = origin[u] + corner[u] * w;
+        position[v] = origin[v] + corner[v] * h;
+
+        vertices->push_back(ChunkVertex(position[0], position[1], position[2], face, (ao >> (2 * split[i])) & 3,
+                                        type));
+    }
+}
+
+unsigned int ChunkMesher::Occlusion(const unsigned short *types, int face, int x, int y, int z)
+{
+    int d = face / 2;
+    int u = (d + 1) % 3;
+    int v = (d + 2) % 3;
+
+    // the cell the face looks into
+    int p[3] = {x + normals[face].x, y + normals[face].y, z + normals[face].z};
+
+    unsigned int ao = 0;
+    for(int k=0; k<4; ++k)
+    {
+        const glm::i8vec4 &corner = corners[face][k];
+        int du = corner[u] ? 1 : -1;
+        int dv = corner[v] ? 1 : -1;
+
+        int a[3] = {p[0], p[1], p[2]};
+        int b[3] = {p[0], p[1], p[2]};
+        a[u] += du;
+        b[v] += dv;
+        int c[3] = {a[0], a[1], a[2]};
+        c[v] += dv;
+
+        bool side_a = types[Padded(a[0], a[1], a[2])] != BLOCK_TYPE_AIR;
+        bool side_b = types[Padded(b[0], b[1], b[2])] != BLOCK_TYPE_AIR;
+        bool diagonal = types[Padded(c[0], c[1], c[2])] != BLOCK_TYPE_AIR;
+
+        // two sides already hide the corner completely
+        unsigned int level = side_a && side_b ? 0 : 3 - side_a - side_b - diagonal;
+        ao |= level << (2 * k);
+    }
+
+    return ao;
+}
+
+void ChunkMesher::Gather(const ChunkStorage *chunk, const ChunkStorage * const *neighbours, unsigned short *types)
+{
+    for(int i=0; i<MESHER_PAD_TOTAL; ++i) types[i] = BLOCK_TYPE_AIR;
+
+    // decode the palette once instead of per lookup
+    std::vector<unsigned short> interior(CHUNK_TOTAL);
+    chunk->Unpack(&interior[0]);
+
+    for(int z=0; z<CHUNK_Z; ++z)
+    {
+        for(int y=0; y<CHUNK_Y; ++y)
+        {
+            memcpy(&types[Padded(0, y, z)], &interior[y * CHUNK_X + z * CHUNK_X * CHUNK_Y], CHUNK_X * sizeof(unsigned short));
+        }
+    }
+
+    // the touching plane of each neighbour, the border edges and corners stay empty
+    for(int z=0; z<CHUNK_Z; ++z)
+    {
+        for(int y=0; y<CHUNK_Y; ++y)
+        {
+            if(neighbours[FACE_LEFT]) types[Padded(-1, y, z)] = neighbours[FACE_LEFT]->GetType(CHUNK_X - 1, y, z);
+            if(neighbours[FACE_RIGHT]) types[Padded(CHUNK_X, y, z)] = neighbours[FACE_RIGHT]->GetType(0, y, z);
+        }
+
+        for(int x=0; x<CHUNK_X; ++x)
+        {
+            if(neighbours[FACE_BOTTOM]) types[Padded(x, -1, z)] = neighbours[FACE_BOTTOM]->GetType(x, CHUNK_Y - 1, z);
+            if(neighbours[FACE_TOP]) types[Padded(x, CHUNK_Y, z)] = neighbours[FACE_TOP]->GetType(x, 0, z);
+        }
+    }
+
+    for(int y=0; y<CHUNK_Y; ++y)
+    {
+        for(int x=0; x<CHUNK_X; ++x)
+        {
+            if(neighbours[FACE_FRONT]) types[Padded(x, y, -1)] = neighbours[FACE_FRONT]->GetType(x, y, CHUNK_Z - 1);
+            if(neighbours[FACE_BACK]) types[Padded(x, y, CHUNK_Z)] = neighbours[FACE_BACK]->GetType(x, y, 0);
+        }
+    }
+}
+
+void ChunkMesher::BuildSimple(const unsigned short *types, std::vector<ChunkVertex> *vertices)
+{
+    for(int z=0; z<CHUNK_Z; ++z)
+    {
+        for(int y=0; y<CHUNK_Y; ++y)
+        {
+            for(int x=0; x<CHUNK_X; ++x)
+            {
+                if(types[Padded(x, y, z)] == BLOCK_TYPE_AIR) continue;
+
+                int origin[3] = {x, y, z};
+                for(int face=0; face<NUM_BLOCK_FACES; ++face)
+                {
+                    const glm::i8vec4 &n = normals[face];
+                    if(types[Padded(x + n.x, y + n.y, z + n.z)] != BLOCK_TYPE_AIR) continue;
+
+                    EmitQuad(vertices, face, origin, 1, 1, types[Padded(x, y, z)], Occlusion(types, face, x, y, z));
+                }
+            }
+        }
+    }
+}
+
+void ChunkMesher::BuildGreedy(const unsigned short *types, std::vector<ChunkVertex> *vertices)
+{
+    static const int size[3] = {CHUNK_X, CHUNK_Y, CHUNK_Z};
+
+    /* type and occlusion of the visible face at each cell of a slice, 0 where there is none, sized for any axis
+     * faces only merge when both match, so every corner of a merged quad has the same occlusion
+     */
+    unsigned int mask[CHUNK_X * CHUNK_Y + CHUNK_Y * CHUNK_Z + CHUNK_Z * CHUNK_X];
+
+    for(int face=0; face<NUM_BLOCK_FACES; ++face)
+    {
+        int d = face / 2;
+        int u = (d + 1) % 3;
+        int v = (d + 2) % 3;
+        const glm::i8vec4 &n = normals[face];
+
+        for(int slice=0; slice<size[d]; ++slice)
+        {
+            int position[3];
+            position[d] = slice;
+
+            bool any = false;
+            for(int j=0; j<size[v]; ++j)
+            {
+                position[v] = j;
+                for(int i=0; i<size[u]; ++i)
+                {
+                    position[u] = i;
+
+                    unsigned int key = types[Padded(position[0], position[1], position[2])];
+                    if(types[Padded(position[0] + n.x, position[1] + n.y, position[2] + n.z)] != BLOCK_TYPE_AIR)
+                    {
+                        key = BLOCK_TYPE_AIR;
+                    }
+                    else if(key != BLOCK_TYPE_AIR)
+                    {
+                        key |= Occlusion(types, face, position[0], position[1], position[2]) << 16;
+                    }
+
+                    mask[i + j * size[u]] = key;
+                    any = any || key != BLOCK_TYPE_AIR;
+                }
+            }
+
+            if(!any) continue;
+
+            // grow each unvisited face along u, then along v while every row still matches
+            for(int j=0; j<size[v]; ++j)
+            {
+                for(int i=0; i<size[u];)
+                {
+                    unsigned int key = mask[i + j * size[u]];
+                    if(key == BLOCK_TYPE_AIR)
+                    {
+                        ++i;
+                        continue;
+                    }
+
+                    int w = 1;
+                    while(i + w < size[u] && mask[i + w + j * size[u]] == key) ++w;
+
+                    int h = 1;
+                    for(; j + h < size[v]; ++h)
+                    {
+                        int k = 0;
+                        while(k < w && mask[i + k + (j + h) * size[u]] == key) ++k;
+                        if(k < w) break;
+                    }
+
+                    for(int b=0; b<h; ++b)
+                    {
+                        for(int a=0; a<w; ++a) mask[i + a + (j + b) * size[u]] = BLOCK_TYPE_AIR;
+                    }
+
+                    position[u] = i;
+                    position[v] = j;
+                    EmitQuad(vertices, face, position, w, h, key & 0xffff, key >> 16);
+
+                    i += w;
+                }
+            }
+        }
+    }
+}
+
+void ChunkMesher::Build(const ChunkStorage *chunk, const ChunkStorage * const *neighbours,
+                        std::vector<ChunkVertex> *vertices, MesherMode mode)
+{
+    vertices->clear();
+    if(chunk->IsEmpty()) return;
+
+    std::vector<unsigned short> types(MESHER_PAD_TOTAL);
+    Gather(chunk, neighbours, &types[0]);
+
+    switch(mode)
+    {
+        case MESHER_GREEDY:
+            BuildGreedy(&types[0], vertices);
+            break;
+        default:
+            BuildSimple(&types[0], vertices);
+            break;
+    }
+}
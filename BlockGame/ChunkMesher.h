@@ -0,0 +1,81 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CHUNKMESHER_H
+#define CHUNKMESHER_H
+
+#include <vector>
+
+#include "Chunk.h"
+
+// same order as the faces of Block
+enum BlockFace
+{
+    FACE_LEFT,
+    FACE_RIGHT,
+    FACE_BOTTOM,
+    FACE_TOP,
+    FACE_FRONT,
+    FACE_BACK,
+    NUM_BLOCK_FACES
+};
+
+// chunk types plus a one block border taken from the neighbours
+#define MESHER_PAD_X (CHUNK_X + 2)
+#define MESHER_PAD_Y (CHUNK_Y + 2)
+#define MESHER_PAD_Z (CHUNK_Z + 2)
+#define MESHER_PAD_TOTAL (MESHER_PAD_X * MESHER_PAD_Y * MESHER_PAD_Z)
+
+enum MesherMode
+{
+    // one quad per visible block face
+    MESHER_SIMPLE,
+    // visible faces of the same type merged into rectangles, slice by slice
+    MESHER_GREEDY,
+    NUM_MESHER_MODES
+};
+
+class ChunkMesher
+{
+protected:
+    static const glm::i8vec4 normals[NUM_BLOCK_FACES];
+
+    // corners of each face of a unit block, counter-clockwise seen from outside
+    static const glm::i8vec4 corners[NUM_BLOCK_FACES][4];
+
+    // appends a w by h quad starting at origin, stretched along the two axes of the face
+    static void EmitQuad(std::vector<ChunkVertex> *vertices, int face, const int *origin, int w, int h,
+                         unsigned short type, unsigned int ao);
+
+    // occlusion of the four corners of a face in corners order, two bits each
+    static unsigned int Occlusion(const unsigned short *types, int face, int x, int y, int z);
+
+    // unpacks chunk and the touching planes of its neighbours into a padded type grid
+    static void Gather(const ChunkStorage *chunk, const ChunkStorage * const *neighbours, unsigned short *types);
+
+    static void BuildSimple(const unsigned short *types, std::vector<ChunkVertex> *vertices);
+    static void BuildGreedy(const unsigned short *types, std::vector<ChunkVertex> *vertices);
+public:
+    static const char *mode_names[NUM_MESHER_MODES];
+
+    /* builds a triangle list of every face of chunk not covered by a solid block
+     * neighbours are indexed by BlockFace, a NULL neighbour counts as empty
+     */
+    static void Build(const ChunkStorage *chunk, const ChunkStorage * const *neighbours,
+                      std::vector<ChunkVertex> *vertices, MesherMode mode = MESHER_SIMPLE);
+};
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ChunkRegion.h"
+
+bool RegionFile::Open(const char *path)
+{
+    this->Close();
+
+    this->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(this->fd < 0)
+    {
+        fprintf(stderr, "RegionFile::Open: error: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(this->fd, &st) < 0)
+    {
+        fprintf(stderr, "RegionFile::Open: error: %s: %s\n", path, strerror(errno));
+        this->Close();
+        return false;
+    }
+
+    Uint32 header[REGION_HEADER_SIZE / sizeof(Uint32)];
+
+    // a new region is just the header with every chunk missing
+    if(st.st_size == 0)
+    {
+        memset(header, 0, sizeof(header));
+        header[0] = SDL_SwapLE32(REGION_MAGIC);
+        header[1] = SDL_SwapLE32(REGION_VERSION);
+
+        if(pwrite(this->fd, header, sizeof(header), 0) != (ssize_t)sizeof(header))
+        {
+            fprintf(stderr, "RegionFile::Open: error: %s: failed to write header\n", path);
+            this->Close();
+            return false;
+        }
+
+        memset(this->offsets, 0, sizeof(this->offsets));
+        memset(this->lengths, 0, sizeof(this->lengths));
+        this->num_sectors = SectorsFor(REGION_HEADER_SIZE);
+        return true;
+    }
+
+    if(pread(this->fd, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+       SDL_SwapLE32(header[0]) != REGION_MAGIC || SDL_SwapLE32(header[1]) != REGION_VERSION)
+    {
+        fprintf(stderr, "RegionFile::Open: error: %s: not a region file\n", path);
+        this->Close();
+        return false;
+    }
+
+    Uint32 first_sector = SectorsFor(REGION_HEADER_SIZE);
+    this->num_sectors = SectorsFor(st.st_size);
+    if(this->num_sectors < first_sector) this->num_sectors = first_sector;
+
+    // entries pointing into the header or past the end of the file count as missing
+    for(unsigned long i=0; i<REGION_TOTAL; ++i)
+    {
+        this->offsets[i] = SDL_SwapLE32(header[2 + i * 2]);
+        this->lengths[i] = SDL_SwapLE32(header[2 + i * 2 + 1]);
+
+        if(this->offsets[i] < first_sector ||
+           (Uint64)this->offsets[i] * REGION_SECTOR_SIZE + this->lengths[i] > (Uint64)st.st_size)
+        {
+            this->offsets[i] = 0;
+            this->lengths[i] = 0;
+        }
+    }
+
+    return true;
+}
+
+void RegionFile::Close(void)
+{
+    if(this->fd >= 0) close(this->fd);
+    this->fd = -1;
+}
+
+bool RegionFile::WriteEntry(unsigned long index)
+{
+    Uint32 entry[2] = { SDL_SwapLE32(this->offsets[index]), SDL_SwapLE32(this->lengths[index]) };
+    off_t at = 2 * sizeof(Uint32) + index * sizeof(entry);
+    return pwrite(this->fd, entry, sizeof(entry), at) == (ssize_t)sizeof(entry);
+}
+
+ChunkStorage * RegionFile::Read(unsigned long index)
+{
+    if(this->fd < 0 || !this->Has(index)) return NULL;
+
+    std::vector<unsigned char> data(this->lengths[index]);
+    off_t at = (off_t)this->offsets[index] * REGION_SECTOR_SIZE;
+    if(pread(this->fd, &data[0], data.size(), at) != (ssize_t)data.size())
+    {
+        fprintf(stderr, "RegionFile::Read: error: chunk %lu: %s\n", index, strerror(errno));
+        return NULL;
+    }
+
+    ChunkStorage *storage = new ChunkStorage;
+    if(!storage->Deserialize(&data[0], data.size()))
+    {
+        fprintf(stderr, "RegionFile::Read: error: chunk %lu is corrupt\n", index);
+        ChunkStorage::Release(storage);
+        return NULL;
+    }
+
+    return storage;
+}
+
+bool RegionFile::Write(unsigned long index, const std::vector<unsigned char> &data)
+{
+    if(this->fd < 0 || data.empty()) return false;
+
+    // sectors left behind by a moved chunk are not reused
+    Uint32 sectors = SectorsFor(data.size());
+    Uint32 offset = this->offsets[index];
+    if(!this->Has(index) || SectorsFor(this->lengths[index]) < sectors)
+    {
+        offset = this->num_sectors;
+        this->num_sectors += sectors;
+    }
+
+    if(pwrite(this->fd, &data[0], data.size(), (off_t)offset * REGION_SECTOR_SIZE) != (ssize_t)data.size())
+    {
+        fprintf(stderr, "RegionFile::Write: error: chunk %lu: %s\n", index, strerror(errno));
+        return false;
+    }
+
+    // the entry goes last so it never points at half written data in new sectors
+    this->offsets[index] = offset;
+    this->lengths[index] = data.size();
+    if(!this->WriteEntry(index))
+    {
+        fprintf(stderr, "RegionFile::Write: error: chunk %lu: failed to write entry\n", index);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,87 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CHUNKREGION_H
+#define CHUNKREGION_H
+
+#include <vector>
+
+#include <SDL.h>
+
+#include "Object.h"
+#include "Chunk.h"
+
+// chunks per region file along each axis
+#define REGION_X 8
+#define REGION_Y 8
+#define REGION_Z 8
+#define REGION_TOTAL (REGION_X * REGION_Y * REGION_Z)
+
+// chunks are stored in whole sectors so a rewrite that still fits stays in place
+#define REGION_SECTOR_SIZE 4096
+
+#define REGION_MAGIC 0x47524742 // "BGRG" little-endian
+#define REGION_VERSION 1
+
+/* magic, version, then one entry per chunk in Chunk block order: the first sector
+ * and the length in bytes, 0 for a chunk never written, integers little-endian
+ */
+#define REGION_HEADER_SIZE (2 * sizeof(Uint32) + REGION_TOTAL * 2 * sizeof(Uint32))
+
+/* many chunks in one file, read and written in place with pread and pwrite
+ * the offset table is kept in memory, only the I/O thread touches a region
+ */
+class RegionFile : Object<RegionFile>
+{
+protected:
+    int fd;
+
+    // first sector and length of every chunk, host order
+    Uint32 offsets[REGION_TOTAL];
+    Uint32 lengths[REGION_TOTAL];
+
+    // sectors in the file including the header, new chunks go at the end
+    Uint32 num_sectors;
+
+    static inline Uint32 SectorsFor(Uint32 len) { return (len + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE; }
+
+    bool WriteEntry(unsigned long index);
+public:
+    RegionFile() : fd(-1), num_sectors(0) {}
+    ~RegionFile() { this->Close(); }
+
+    // opens or creates the region at path, a file with a bad header is refused
+    bool Open(const char *path);
+    void Close(void);
+
+    // slot of a chunk in the region holding it, chunk coordinates may be negative
+    static inline unsigned long Index(int x, int y, int z)
+    {
+        return (x - FloorDiv(x, REGION_X) * REGION_X) +
+               (y - FloorDiv(y, REGION_Y) * REGION_Y) * REGION_X +
+               (z - FloorDiv(z, REGION_Z) * REGION_Z) * REGION_X * REGION_Y;
+    }
+
+    inline bool Has(unsigned long index) const { return this->lengths[index] != 0; }
+
+    // NULL if the chunk was never written or its data is unreadable
+    ChunkStorage * Read(unsigned long index);
+
+    // replaces the chunk, moving it to the end of the file if it outgrew its sectors
+    bool Write(unsigned long index, const std::vector<unsigned char> &data);
+};
+
+#endif
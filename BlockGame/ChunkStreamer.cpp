@@ -0,0 +1,304 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "ChunkStreamer.h"
+
+bool ChunkStreamer::Init(const char *path, Uint32 seed)
+{
+    this->path = path;
+
+    if(mkdir(path, 0755) < 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "ChunkStreamer::Init: error: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    this->lock = SDL_CreateMutex();
+    this->wake = SDL_CreateCond();
+    if(!this->lock || !this->wake)
+    {
+        fprintf(stderr, "ChunkStreamer::Init: error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    if(!this->generator.Init(seed)) return false;
+
+    this->thread = SDL_CreateThread(ThreadMain, "streamer", this);
+    if(!this->thread)
+    {
+        fprintf(stderr, "ChunkStreamer::Init: error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+void ChunkStreamer::Destroy(void)
+{
+    if(this->lock)
+    {
+        SDL_LockMutex(this->lock);
+        this->b_quit = true;
+        SDL_CondSignal(this->wake);
+        SDL_UnlockMutex(this->lock);
+    }
+
+    if(this->thread) SDL_WaitThread(this->thread, NULL);
+    this->thread = NULL;
+
+    // nothing submits to the generator any more
+    this->generator.Destroy();
+
+    // only left over if the thread never started
+    for(std::vector<ChunkSaveRequest>::iterator i=this->saves.begin(); i!=this->saves.end(); ++i)
+    {
+        ChunkStorage::Release(i->storage);
+    }
+    this->saves.clear();
+    this->loads.clear();
+
+    for(ChunkLoadResult *r=this->Poll(), *next; r; r=next)
+    {
+        next = r->next;
+        ChunkStorage::Release(r->storage);
+        delete r;
+    }
+
+    for(std::map<Uint64, OpenRegion>::iterator i=this->regions.begin(); i!=this->regions.end(); ++i)
+    {
+        delete i->second.file;
+    }
+    this->regions.clear();
+
+    if(this->wake) SDL_DestroyCond(this->wake);
+    if(this->lock) SDL_DestroyMutex(this->lock);
+    this->wake = NULL;
+    this->lock = NULL;
+}
+
+int ChunkStreamer::ThreadMain(void *data)
+{
+    ((ChunkStreamer *)data)->Work();
+    return 0;
+}
+
+void ChunkStreamer::Work(void)
+{
+    for(;;)
+    {
+        SDL_LockMutex(this->lock);
+        while(!this->b_quit && this->saves.empty() && this->loads.empty()) SDL_CondWait(this->wake, this->lock);
+
+        // saves first, and all of them before quitting
+        if(!this->saves.empty())
+        {
+            std::vector<ChunkSaveRequest> saves;
+            saves.swap(this->saves);
+            SDL_UnlockMutex(this->lock);
+
+            for(std::vector<ChunkSaveRequest>::iterator i=saves.begin(); i!=saves.end(); ++i) this->DoSave(*i);
+            continue;
+        }
+
+        if(this->b_quit)
+        {
+            SDL_UnlockMutex(this->lock);
+            return;
+        }
+
+        std::pop_heap(this->loads.begin(), this->loads.end(), Nearer);
+        ChunkLoadRequest request = this->loads.back();
+        this->loads.pop_back();
+        SDL_UnlockMutex(this->lock);
+
+        this->DoLoad(request);
+    }
+}
+
+RegionFile * ChunkStreamer::GetRegion(int x, int y, int z)
+{
+    int rx = FloorDiv(x, REGION_X), ry = FloorDiv(y, REGION_Y), rz = FloorDiv(z, REGION_Z);
+    Uint64 key = ChunkKey(rx, ry, rz);
+
+    std::map<Uint64, OpenRegion>::iterator i = this->regions.find(key);
+    if(i != this->regions.end())
+    {
+        i->second.last_used = ++this->region_uses;
+        return i->second.file;
+    }
+
+    if(this->regions.size() >= STREAMER_MAX_REGIONS)
+    {
+        std::map<Uint64, OpenRegion>::iterator oldest = this->regions.begin();
+        for(i=this->regions.begin(); i!=this->regions.end(); ++i)
+        {
+            if(i->second.last_used < oldest->second.last_used) oldest = i;
+        }
+
+        delete oldest->second.file;
+        this->regions.erase(oldest);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/r.%d.%d.%d.bgr", rx, ry, rz);
+
+    RegionFile *file = new RegionFile;
+    if(!file->Open((this->path + name).c_str()))
+    {
+        delete file;
+        return NULL;
+    }
+
+    OpenRegion region;
+    region.file = file;
+    region.last_used = ++this->region_uses;
+    this->regions[key] = region;
+
+    return file;
+}
+
+void ChunkStreamer::DoLoad(const ChunkLoadRequest &request)
+{
+    ChunkStorage *storage = NULL;
+
+    RegionFile *region = this->GetRegion(request.x, request.y, request.z);
+    if(region) storage = region->Read(RegionFile::Index(request.x, request.y, request.z));
+
+    // unsaved chunks are generated again each time instead of taking disk space
+    if(!storage)
+    {
+        this->generator.Submit(request.x, request.y, request.z, request.priority);
+        return;
+    }
+
+    ChunkLoadResult *result = new ChunkLoadResult;
+    result->x = request.x;
+    result->y = request.y;
+    result->z = request.z;
+    result->storage = storage;
+
+    // push onto the results stack, Poll takes the whole stack so there is no ABA
+    void *head;
+    do
+    {
+        head = SDL_AtomicGetPtr(&this->results);
+        result->next = (ChunkLoadResult *)head;
+    } while(!SDL_AtomicCASPtr(&this->results, head, result));
+}
+
+void ChunkStreamer::DoSave(const ChunkSaveRequest &request)
+{
+    std::vector<unsigned char> data;
+    request.storage->Serialize(&data);
+    ChunkStorage::Release(request.storage);
+
+    RegionFile *region = this->GetRegion(request.x, request.y, request.z);
+    if(!region || !region->Write(RegionFile::Index(request.x, request.y, request.z), data))
+    {
+        fprintf(stderr, "ChunkStreamer::DoSave: error: chunk %d %d %d was not saved\n",
+                request.x, request.y, request.z);
+    }
+}
+
+void ChunkStreamer::Load(int x, int y, int z, float priority)
+{
+    ChunkLoadRequest request;
+    request.x = x;
+    request.y = y;
+    request.z = z;
+    request.priority = priority;
+
+    SDL_LockMutex(this->lock);
+
+    SDL_AtomicIncRef(&this->in_flight);
+    this->loads.push_back(request);
+    std::push_heap(this->loads.begin(), this->loads.end(), Nearer);
+
+    SDL_CondSignal(this->wake);
+    SDL_UnlockMutex(this->lock);
+}
+
+void ChunkStreamer::Save(int x, int y, int z, const ChunkStorage *storage)
+{
+    ChunkSaveRequest request;
+    request.x = x;
+    request.y = y;
+    request.z = z;
+    request.storage = storage;
+
+    SDL_LockMutex(this->lock);
+    this->saves.push_back(request);
+    SDL_CondSignal(this->wake);
+    SDL_UnlockMutex(this->lock);
+}
+
+void ChunkStreamer::Prioritise(const glm::vec3 &position)
+{
+    SDL_LockMutex(this->lock);
+
+    for(std::vector<ChunkLoadRequest>::iterator i=this->loads.begin(); i!=this->loads.end(); ++i)
+    {
+        glm::vec3 centre = glm::vec3(i->x * CHUNK_X, i->y * CHUNK_Y, i->z * CHUNK_Z) +
+                           glm::vec3(CHUNK_X, CHUNK_Y, CHUNK_Z) * 0.5f - position;
+        i->priority = glm::dot(centre, centre);
+    }
+    std::make_heap(this->loads.begin(), this->loads.end(), Nearer);
+
+    SDL_UnlockMutex(this->lock);
+
+    this->generator.Prioritise(position);
+}
+
+ChunkLoadResult * ChunkStreamer::Poll(void)
+{
+    ChunkLoadResult *head = (ChunkLoadResult *)SDL_AtomicSetPtr(&this->results, NULL);
+
+    // generated chunks go in with the ones read from disk
+    for(ChunkGenerateResult *r=this->generator.Poll(), *next; r; r=next)
+    {
+        next = r->next;
+
+        ChunkLoadResult *result = new ChunkLoadResult;
+        result->x = r->x;
+        result->y = r->y;
+        result->z = r->z;
+        result->storage = r->storage;
+        result->next = head;
+        head = result;
+
+        delete r;
+    }
+
+    // the stack is newest first
+    ChunkLoadResult *ordered = NULL;
+    while(head)
+    {
+        ChunkLoadResult *next = head->next;
+        head->next = ordered;
+        ordered = head;
+        head = next;
+
+        SDL_AtomicAdd(&this->in_flight, -1);
+    }
+
+    return ordered;
+}
@@ -0,0 +1,136 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CHUNKSTREAMER_H
+#define CHUNKSTREAMER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <SDL.h>
+
+#include "Chunk.h"
+#include "ChunkRegion.h"
+#include "ChunkGenerator.h"
+
+// region files kept open at once, the least recently used is closed past this
+#define STREAMER_MAX_REGIONS 32
+
+struct ChunkLoadRequest
+{
+    int x, y, z;
+
+    // squared distance to the camera, nearest first
+    float priority;
+};
+
+// a snapshot of a modified chunk, serialized and released by the I/O thread
+struct ChunkSaveRequest
+{
+    int x, y, z;
+    const ChunkStorage *storage;
+};
+
+// blocks read from disk or generated, linked into the results stack
+struct ChunkLoadResult
+{
+    int x, y, z;
+
+    // owned by whoever takes the result
+    ChunkStorage *storage;
+
+    ChunkLoadResult *next;
+};
+
+struct OpenRegion
+{
+    RegionFile *file;
+    unsigned long last_used;
+};
+
+/* reads and writes chunks in region files on one I/O thread
+ * saves are always written before any later load so a chunk evicted and wanted
+ * again reads back its latest blocks
+ */
+class ChunkStreamer : Object<ChunkStreamer>
+{
+protected:
+    SDL_Thread *thread;
+
+    // pending loads as a heap on priority, saves in order, guarded by lock
+    std::vector<ChunkLoadRequest> loads;
+    std::vector<ChunkSaveRequest> saves;
+    SDL_mutex *lock;
+    SDL_cond *wake;
+    bool b_quit;
+
+    // loads submitted but not yet handed back by Poll
+    SDL_atomic_t in_flight;
+
+    // finished loads pushed by the I/O thread, taken all at once by the GL thread
+    void *results;
+
+    // directory holding the region files
+    std::string path;
+
+    // fills chunks that are not on disk
+    ChunkGenerator generator;
+
+    // only touched by the I/O thread
+    std::map<Uint64, OpenRegion> regions;
+    unsigned long region_uses;
+
+    static bool Nearer(const ChunkLoadRequest &a, const ChunkLoadRequest &b) { return a.priority > b.priority; }
+    static int ThreadMain(void *data);
+
+    void Work(void);
+
+    // the region holding a chunk, opened or created on first use, NULL on error
+    RegionFile * GetRegion(int x, int y, int z);
+
+    void DoLoad(const ChunkLoadRequest &request);
+    void DoSave(const ChunkSaveRequest &request);
+public:
+    ChunkStreamer() : thread(NULL), lock(NULL), wake(NULL), b_quit(false), results(NULL), region_uses(0)
+    {
+        SDL_AtomicSet(&this->in_flight, 0);
+    }
+
+    // creates the world directory at path if needed and starts the I/O thread and the generator
+    bool Init(const char *path, Uint32 seed = GEN_DEFAULT_SEED);
+
+    // writes every queued save before stopping, pending loads are dropped
+    void Destroy(void);
+
+    inline bool IsIdle(void) { return SDL_AtomicGet(&this->in_flight) == 0; }
+
+    inline ChunkGenerator * GetGenerator(void) { return &this->generator; }
+
+    // queues a read of a chunk, generating it if it is not on disk
+    void Load(int x, int y, int z, float priority);
+
+    // queues a write of storage, taking over the reference
+    void Save(int x, int y, int z, const ChunkStorage *storage);
+
+    // orders pending loads by distance to position, in blocks
+    void Prioritise(const glm::vec3 &position);
+
+    // finished loads oldest first, the caller deletes them
+    ChunkLoadResult * Poll(void);
+};
+
+#endif
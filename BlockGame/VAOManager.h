@@ -17,7 +17,10 @@
 #ifndef VAOMANAGER_H
 #define VAOMANAGER_H
 
-#include <vector>
+#include <string.h>
+#include <map>
+
+#include <SDL.h>
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -26,43 +29,117 @@
 #include <glm/gtc/type_precision.hpp>
 
 #include "glcommon.h"
+#include "Block.h"
 
+// one shape on the GPU, shared by every Block with the same vertices and normals
 struct VAO
 {
-    glm::i8vec4 *vertices;
     GLuint id;
+    GLuint vbo_vertex;
+    GLuint vbo_normal;
+
+    // kept to tell apart shapes whose hashes collide
+    glm::i8vec4 *vertices;
+    glm::i8vec4 *normals;
+    unsigned long size;
+
+    Uint64 hash;
+    unsigned long refs;
 };
 
 class VAOManager
 {
+protected:
+    // shapes by the hash of their data, equal hashes are compared in full
+    std::multimap<Uint64, VAO *> vaos;
+
+    // 64-bit FNV-1a over the vertices then the normals
+    static inline Uint64 Hash(const glm::i8vec4 *vertices, const glm::i8vec4 *normals, unsigned long size)
+    {
+        Uint64 hash = 14695981039346656037ULL;
+
+        const unsigned char *bytes = (const unsigned char *)vertices;
+        for(unsigned long i=0; i<size * sizeof(glm::i8vec4); ++i) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+
+        bytes = (const unsigned char *)normals;
+        for(unsigned long i=0; i<size * sizeof(glm::i8vec4); ++i) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+
+        return hash;
+    }
 public:
-    std::vector<VAO *> vaos;
+    inline unsigned long GetCount(void) const { return this->vaos.size(); }
 
-    inline VAO * GetVAOFor(glm::i8vec4 *vertices, unsigned long size)
+    // a shared VAO with its VBOs filled, created on first use, Release it when done
+    inline VAO * Acquire(const glm::i8vec4 *vertices, const glm::i8vec4 *normals, unsigned long size)
     {
-        for(unsigned long i=0; i<this->vaos.size(); ++i)
+        Uint64 hash = Hash(vertices, normals, size);
+
+        typedef std::multimap<Uint64, VAO *>::iterator iterator;
+        std::pair<iterator, iterator> range = this->vaos.equal_range(hash);
+        for(iterator i=range.first; i!=range.second; ++i)
         {
-            bool match = true;
-            for(unsigned long v=0; v<size; ++v)
+            VAO *vao = i->second;
+            if(vao->size == size &&
+               !memcmp(vao->vertices, vertices, sizeof(glm::i8vec4) * size) &&
+               !memcmp(vao->normals, normals, sizeof(glm::i8vec4) * size))
             {
-                if(this->vaos[i]->vertices[v] != vertices[v])
-                {
-                    match = false;
-                    break;
-                }
+                ++vao->refs;
+                return vao;
             }
-
-            if(match) return this->vaos[i];
         }
 
         VAO *vao = new VAO();
-        vao->vertices = (glm::i8vec4 *)malloc(sizeof(glm::i8vec4) * size);
+        vao->vertices = new glm::i8vec4[size];
+        vao->normals = new glm::i8vec4[size];
         memcpy(vao->vertices, vertices, sizeof(glm::i8vec4) * size);
+        memcpy(vao->normals, normals, sizeof(glm::i8vec4) * size);
+        vao->size = size;
+        vao->hash = hash;
+        vao->refs = 1;
+
         glGenVertexArrays(1, &vao->id);
+        glBindVertexArray(vao->id);
+
+        glGenBuffers(1, &vao->vbo_vertex);
+        glBindBuffer(GL_ARRAY_BUFFER, vao->vbo_vertex);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::i8vec4) * size, vertices, GL_STATIC_DRAW);
+        glVertexAttribIPointer(BLOCK_ATTRIB_VERTEX, 4, GL_BYTE, 0, NULL);
+        glEnableVertexAttribArray(BLOCK_ATTRIB_VERTEX);
 
-        this->vaos.push_back(vao);
+        glGenBuffers(1, &vao->vbo_normal);
+        glBindBuffer(GL_ARRAY_BUFFER, vao->vbo_normal);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::i8vec4) * size, normals, GL_STATIC_DRAW);
+        glVertexAttribIPointer(BLOCK_ATTRIB_NORMAL, 4, GL_BYTE, 0, NULL);
+        glEnableVertexAttribArray(BLOCK_ATTRIB_NORMAL);
+
+        this->vaos.insert(std::make_pair(hash, vao));
         return vao;
     }
+
+    // the last release frees the VAO and its VBOs
+    inline void Release(VAO *vao)
+    {
+        if(!vao || --vao->refs > 0) return;
+
+        typedef std::multimap<Uint64, VAO *>::iterator iterator;
+        std::pair<iterator, iterator> range = this->vaos.equal_range(vao->hash);
+        for(iterator i=range.first; i!=range.second; ++i)
+        {
+            if(i->second == vao)
+            {
+                this->vaos.erase(i);
+                break;
+            }
+        }
+
+        glDeleteBuffers(1, &vao->vbo_vertex);
+        glDeleteBuffers(1, &vao->vbo_normal);
+        glDeleteVertexArrays(1, &vao->id);
+
+        delete[] vao->vertices;
+        delete[] vao->normals;
+        delete vao;
+    }
 };
 
 #endif
@@ -0,0 +1,242 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "AssetArchive.h"
+#include "ResourceManager.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the header and index are read in place from the mapping
+#if SDL_BYTEORDER != SDL_LIL_ENDIAN
+#error "AssetArchive reads little-endian archives in place"
+#endif
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+
+bool AssetArchive::Open(const char *path)
+{
+    this->Close();
+
+    Resource *file = ResourceManager::Load(path);
+    if(!file) return false;
+
+    const char *data = file->GetData();
+    Uint64 size = (Uint64)file->GetSize();
+
+    const AssetHeader *header = (const AssetHeader *)data;
+    if(size < sizeof(AssetHeader) || header->magic != ASSET_MAGIC || header->version != ASSET_VERSION)
+    {
+        fprintf(stderr, "AssetArchive: `%s` is not an asset archive\n", path);
+        ResourceManager::Release(file);
+        return false;
+    }
+
+    if(header->index_offset % sizeof(Uint64) != 0 || header->index_offset > size ||
+       (size - header->index_offset) / sizeof(AssetEntry) < header->count ||
+       header->names_offset < header->index_offset + (Uint64)header->count * sizeof(AssetEntry) ||
+       header->names_offset > size)
+    {
+        fprintf(stderr, "AssetArchive: `%s` has a truncated index\n", path);
+        ResourceManager::Release(file);
+        return false;
+    }
+
+    const AssetEntry *entries = (const AssetEntry *)(data + header->index_offset);
+    for(Uint32 i=0; i<header->count; ++i)
+    {
+        const AssetEntry &e = entries[i];
+        bool b_sorted = i == 0 || entries[i - 1].hash <= e.hash;
+        bool b_compressed = (e.flags & ASSET_COMPRESSED) != 0;
+        if(!b_sorted || e.offset > size || size - e.offset < e.stored_size ||
+           (!b_compressed && e.stored_size != e.size) || e.name_offset >= size - header->names_offset)
+        {
+            fprintf(stderr, "AssetArchive: `%s` has a bad index entry %u\n", path, i);
+            ResourceManager::Release(file);
+            return false;
+        }
+    }
+
+    this->file = file;
+    this->entries = entries;
+    this->count = header->count;
+    this->names = data + header->names_offset;
+    this->names_size = size - header->names_offset;
+    return true;
+}
+
+void AssetArchive::Close(void)
+{
+    ResourceManager::Release(this->file);
+    this->file = NULL;
+    this->entries = NULL;
+    this->names = NULL;
+    this->count = 0;
+    this->names_size = 0;
+}
+
+const AssetEntry * AssetArchive::Find(const char *path) const
+{
+    Uint64 hash = Hash(path);
+
+    // first entry with hash, equal hashes are next to each other
+    Uint32 lo = 0, hi = this->count;
+    while(lo < hi)
+    {
+        Uint32 mid = lo + (hi - lo) / 2;
+        if(this->entries[mid].hash < hash) lo = mid + 1;
+        else hi = mid;
+    }
+
+    size_t len = strlen(path);
+    for(; lo<this->count && this->entries[lo].hash == hash; ++lo)
+    {
+        const AssetEntry *e = &this->entries[lo];
+        Uint64 room = this->names_size - e->name_offset;
+        if(len < room && memcmp(this->names + e->name_offset, path, len + 1) == 0) return e;
+    }
+    return NULL;
+}
+
+const char * AssetArchive::GetPayload(const AssetEntry *entry) const
+{
+    return this->file->GetData() + entry->offset;
+}
+
+Uint64 AssetArchive::Hash(const char *path)
+{
+    Uint64 hash = 14695981039346656037ULL;
+    for(const unsigned char *p = (const unsigned char *)path; *p; ++p)
+    {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static inline Uint32 Read32(const unsigned char *p)
+{
+    Uint32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// lengths past 15 continue in bytes of 255 and a final byte under 255
+static void PutLength(unsigned long len, std::vector<unsigned char> *out)
+{
+    for(; len>=255; len-=255) out->push_back(255);
+    out->push_back((unsigned char)len);
+}
+
+static void PutSequence(const unsigned char *literals, unsigned long num_literals, unsigned long offset,
+                        unsigned long match_len, std::vector<unsigned char> *out)
+{
+    unsigned long match_code = match_len ? match_len - LZ_MIN_MATCH : 0;
+    unsigned char token = (unsigned char)(((num_literals < 15 ? num_literals : 15) << 4) |
+                                          (match_code < 15 ? match_code : 15));
+    out->push_back(token);
+    if(num_literals >= 15) PutLength(num_literals - 15, out);
+    out->insert(out->end(), literals, literals + num_literals);
+
+    // the last sequence is only literals
+    if(!match_len) return;
+
+    out->push_back((unsigned char)(offset & 0xFF));
+    out->push_back((unsigned char)(offset >> 8));
+    if(match_code >= 15) PutLength(match_code - 15, out);
+}
+
+void AssetArchive::Compress(const unsigned char *src, unsigned long len, std::vector<unsigned char> *out)
+{
+    out->clear();
+
+    // the last position seen for each hash of 4 bytes
+    std::vector<unsigned long> table(1 << LZ_HASH_BITS, (unsigned long)-1);
+
+    unsigned long anchor = 0, i = 0;
+    while(len >= LZ_MIN_MATCH && i <= len - LZ_MIN_MATCH)
+    {
+        Uint32 seq = Read32(src + i);
+        Uint32 h = (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+        unsigned long candidate = table[h];
+        table[h] = i;
+
+        if(candidate == (unsigned long)-1 || i - candidate > LZ_MAX_OFFSET || Read32(src + candidate) != seq)
+        {
+            ++i;
+            continue;
+        }
+
+        unsigned long match_len = LZ_MIN_MATCH;
+        while(i + match_len < len && src[candidate + match_len] == src[i + match_len]) ++match_len;
+
+        PutSequence(src + anchor, i - anchor, i - candidate, match_len, out);
+        i += match_len;
+        anchor = i;
+    }
+
+    PutSequence(src + anchor, len - anchor, 0, 0, out);
+}
+
+// adds the 255 continued bytes of a length, false if src runs out
+static bool GetLength(const unsigned char **ip, const unsigned char *end, unsigned long *len)
+{
+    unsigned char b;
+    do
+    {
+        if(*ip >= end) return false;
+        b = *(*ip)++;
+        *len += b;
+    } while(b == 255);
+    return true;
+}
+
+bool AssetArchive::Decompress(const unsigned char *src, unsigned long src_len, unsigned char *dst, unsigned long len)
+{
+    const unsigned char *ip = src, *end = src + src_len;
+    unsigned long op = 0;
+
+    while(ip < end)
+    {
+        unsigned char token = *ip++;
+
+        unsigned long num_literals = token >> 4;
+        if(num_literals == 15 && !GetLength(&ip, end, &num_literals)) return false;
+        if(num_literals > (unsigned long)(end - ip) || num_literals > len - op) return false;
+        memcpy(dst + op, ip, num_literals);
+        ip += num_literals;
+        op += num_literals;
+
+        if(ip == end) break;
+
+        if(end - ip < 2) return false;
+        unsigned long offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if(offset == 0 || offset > op) return false;
+
+        unsigned long match_len = token & 15;
+        if(match_len == 15 && !GetLength(&ip, end, &match_len)) return false;
+        match_len += LZ_MIN_MATCH;
+        if(match_len > len - op) return false;
+
+        // a match may overlap what it is copying, so byte by byte
+        for(unsigned long j=0; j<match_len; ++j, ++op) dst[op] = dst[op - offset];
+    }
+
+    return op == len;
+}
@@ -0,0 +1,98 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef ASSETARCHIVE_H
+#define ASSETARCHIVE_H
+
+#include <vector>
+
+#include <SDL.h>
+
+#define ASSET_MAGIC 0x4b504741 // "AGPK" little-endian
+#define ASSET_VERSION 1
+
+// payloads start on this boundary from the start of the file
+#define ASSET_ALIGN 16
+
+// entry flags
+#define ASSET_COMPRESSED 1
+
+/* the archive is the header, the index sorted by path hash, the null terminated
+ * paths, then the payloads, every integer little-endian
+ */
+struct AssetHeader
+{
+    Uint32 magic;
+    Uint32 version;
+    Uint32 count;
+    Uint32 reserved;
+    Uint64 index_offset;
+    Uint64 names_offset;
+};
+
+struct AssetEntry
+{
+    Uint64 hash;
+    Uint64 offset;
+
+    // size of the file, and of the payload which is smaller if compressed
+    Uint32 size;
+    Uint32 stored_size;
+
+    // path relative to names_offset, checked on lookup in case two paths share a hash
+    Uint32 name_offset;
+    Uint32 flags;
+};
+
+class Resource;
+
+// one packed file mapped once, files are found by binary search on their path hash
+class AssetArchive
+{
+protected:
+    Resource *file;
+
+    const AssetEntry *entries;
+    const char *names;
+    Uint32 count;
+    Uint64 names_size;
+public:
+    AssetArchive() : file(NULL), entries(NULL), names(NULL), count(0), names_size(0) {}
+    ~AssetArchive() { this->Close(); }
+
+    // maps the archive and checks its header and index, false if it is not a valid archive
+    bool Open(const char *path);
+    void Close(void);
+
+    inline Resource * GetFile(void) const { return this->file; }
+
+    // NULL if the path is not in the archive
+    const AssetEntry * Find(const char *path) const;
+
+    // the stored bytes of entry, compressed or not
+    const char * GetPayload(const AssetEntry *entry) const;
+
+    // 64 bit FNV-1a of path
+    static Uint64 Hash(const char *path);
+
+    // LZ77 in the LZ4 block layout: literal runs and matches of at least 4 bytes up to 64 KiB back
+    static void Compress(const unsigned char *src, unsigned long len, std::vector<unsigned char> *out);
+
+    // false if src does not decode to exactly len bytes
+    static bool Decompress(const unsigned char *src, unsigned long src_len, unsigned char *dst, unsigned long len);
+};
+
+#endif
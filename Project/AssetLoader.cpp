@@ -0,0 +1,245 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "AssetLoader.h"
+
+SDL_Thread *AssetLoader::workers[LOADER_MAX_WORKERS];
+int AssetLoader::num_workers = 0;
+
+std::vector<TextureJob *> AssetLoader::pending;
+std::vector<TextureJob *> AssetLoader::ready;
+SDL_mutex *AssetLoader::lock = NULL;
+SDL_cond *AssetLoader::wake = NULL;
+SDL_cond *AssetLoader::done = NULL;
+bool AssetLoader::b_quit = false;
+
+TextureJob *AssetLoader::uploading = NULL;
+unsigned int AssetLoader::num_outstanding = 0;
+unsigned int AssetLoader::num_loaded = 0;
+Uint64 AssetLoader::first_request = 0;
+
+bool AssetLoader::Init(void)
+{
+    lock = SDL_CreateMutex();
+    wake = SDL_CreateCond();
+    done = SDL_CreateCond();
+    if(!lock || !wake || !done)
+    {
+        fprintf(stderr, "AssetLoader::Init: error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    // the GL thread keeps a core to itself
+    num_workers = SDL_GetCPUCount() - 1;
+    if(num_workers < 1) num_workers = 1;
+    if(num_workers > LOADER_MAX_WORKERS) num_workers = LOADER_MAX_WORKERS;
+
+    b_quit = false;
+    for(int i=0; i<num_workers; ++i)
+    {
+        workers[i] = SDL_CreateThread(WorkerMain, "AssetLoader", NULL);
+        if(!workers[i])
+        {
+            fprintf(stderr, "SDL_CreateThread: error: %s\n", SDL_GetError());
+            num_workers = i;
+            Destroy();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#define GAME_DOMAIN "AssetLoader::Destroy"
+void AssetLoader::Destroy(void)
+{
+    if(lock)
+    {
+        SDL_LockMutex(lock);
+        b_quit = true;
+        SDL_CondBroadcast(wake);
+        SDL_UnlockMutex(lock);
+    }
+
+    for(int i=0; i<num_workers; ++i) SDL_WaitThread(workers[i], NULL);
+    num_workers = 0;
+
+    for(size_t i=0; i<pending.size(); ++i) delete pending[i];
+    for(size_t i=0; i<ready.size(); ++i) delete ready[i];
+    pending.clear();
+    ready.clear();
+
+    if(uploading)
+    {
+        if(uploading->id)
+        {
+            ASSERT_GL(glDeleteTextures(1, &uploading->id))
+        }
+        delete uploading;
+        uploading = NULL;
+    }
+    num_outstanding = 0;
+
+    if(done) SDL_DestroyCond(done);
+    if(wake) SDL_DestroyCond(wake);
+    if(lock) SDL_DestroyMutex(lock);
+    done = NULL;
+    wake = NULL;
+    lock = NULL;
+}
+#undef GAME_DOMAIN
+
+int AssetLoader::WorkerMain(void *data)
+{
+    Profiler::NameThread("loader");
+
+    for(;;)
+    {
+        SDL_LockMutex(lock);
+        while(pending.empty() && !b_quit) SDL_CondWait(wake, lock);
+        if(b_quit)
+        {
+            SDL_UnlockMutex(lock);
+            return 0;
+        }
+
+        TextureJob *job = pending.front();
+        pending.erase(pending.begin());
+        SDL_UnlockMutex(lock);
+
+        // everything but the upload itself
+        job->b_failed = !TextureManager::DecodeBMP(job->path.c_str(), &job->image, job->flip_x, job->flip_y);
+        if(!job->b_failed) TextureManager::BuildMipmaps(&job->image);
+
+        SDL_LockMutex(lock);
+        ready.push_back(job);
+        SDL_CondSignal(done);
+        SDL_UnlockMutex(lock);
+    }
+}
+
+void AssetLoader::LoadTexture(const char *path, GLenum texture_unit, GLfloat aniso, const GLubyte rgba[4],
+                              GLuint *target, bool flip_x, bool flip_y)
+{
+    TextureJob *job = new TextureJob;
+    job->path = path;
+    job->texture_unit = texture_unit;
+    job->aniso = aniso;
+    job->flip_x = flip_x;
+    job->flip_y = flip_y;
+    job->target = target;
+    job->b_failed = false;
+    job->id = 0;
+    job->next_level = 0;
+
+    job->fallback = TextureManager::CreateSolid(texture_unit, rgba);
+    *target = job->fallback;
+
+    if(num_outstanding++ == 0)
+    {
+        first_request = Profiler::Now();
+        num_loaded = 0;
+    }
+
+    SDL_LockMutex(lock);
+    pending.push_back(job);
+    SDL_CondSignal(wake);
+    SDL_UnlockMutex(lock);
+}
+
+#define GAME_DOMAIN "AssetLoader::UploadStep"
+bool AssetLoader::UploadStep(TextureJob *job)
+{
+    ASSERT_GL(glActiveTexture(GL_TEXTURE0 + LOADER_UNIT_UPLOAD))
+    if(!job->id) job->id = TextureManager::CreateTexture(job->aniso, job->image.GetNumLevels());
+    else
+    {
+        ASSERT_GL(glBindTexture(GL_TEXTURE_2D, job->id))
+    }
+
+    TextureManager::UploadLevel(job->image, job->next_level++);
+    ASSERT_GL(glBindTexture(GL_TEXTURE_2D, 0))
+
+    bool b_complete = job->next_level == job->image.GetNumLevels();
+    if(b_complete)
+    {
+        ASSERT_GL(glActiveTexture(job->texture_unit))
+        ASSERT_GL(glBindTexture(GL_TEXTURE_2D, job->id))
+        ASSERT_GL(glDeleteTextures(1, &job->fallback))
+        *job->target = job->id;
+    }
+
+    ASSERT_GL(glActiveTexture(GL_TEXTURE0))
+    return b_complete;
+}
+#undef GAME_DOMAIN
+
+void AssetLoader::Update(double budget_ms)
+{
+    PROFILE_ZONE("AssetLoader::Update");
+
+    if(num_outstanding == 0) return;
+
+    Uint64 start = Profiler::Now();
+    Uint64 budget = (Uint64)(budget_ms * SDL_GetPerformanceFrequency() / 1000.0);
+
+    do
+    {
+        if(!uploading)
+        {
+            SDL_LockMutex(lock);
+            if(!ready.empty())
+            {
+                uploading = ready.front();
+                ready.erase(ready.begin());
+            }
+            SDL_UnlockMutex(lock);
+            if(!uploading) break;
+        }
+
+        // a texture that failed to decode keeps its fallback
+        if(uploading->b_failed || UploadStep(uploading))
+        {
+            if(!uploading->b_failed) ++num_loaded;
+            delete uploading;
+            uploading = NULL;
+
+            if(--num_outstanding == 0)
+            {
+                printf("AssetLoader: %u textures ready in %.1f ms\n", num_loaded,
+                       Profiler::ToMilliseconds(Profiler::Now() - first_request));
+                break;
+            }
+        }
+    } while(Profiler::Now() - start < budget);
+}
+
+void AssetLoader::Finish(void)
+{
+    PROFILE_ZONE("AssetLoader::Finish");
+
+    while(num_outstanding > 0)
+    {
+        SDL_LockMutex(lock);
+        while(ready.empty() && !uploading) SDL_CondWait(done, lock);
+        SDL_UnlockMutex(lock);
+
+        // no budget, everything ready goes up now
+        Update(1e9);
+    }
+}
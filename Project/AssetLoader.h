@@ -0,0 +1,103 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "TextureManager.h"
+
+#define LOADER_MAX_WORKERS 4
+
+// textures are uploaded on this unit so a half uploaded one is never sampled
+#define LOADER_UNIT_UPLOAD 9
+
+// upload time allowed in each frame, at least one mip level goes up every frame
+#define LOADER_FRAME_BUDGET_MS 2.0
+
+struct TextureJob
+{
+    std::string path;
+    GLenum texture_unit;
+    GLfloat aniso;
+    bool flip_x;
+    bool flip_y;
+
+    // holds the fallback until the texture is complete, then the texture
+    GLuint *target;
+    GLuint fallback;
+
+    // filled by a worker
+    TextureImage image;
+    bool b_failed;
+
+    // upload progress on the GL thread
+    GLuint id;
+    int next_level;
+};
+
+/* reads, decodes and mipmaps textures on worker threads, the GL thread uploads the
+ * results a few levels at a time and swaps them in for their fallbacks
+ */
+class AssetLoader
+{
+protected:
+    static SDL_Thread *workers[LOADER_MAX_WORKERS];
+    static int num_workers;
+
+    // jobs waiting for a worker and jobs ready to upload, guarded by lock
+    static std::vector<TextureJob *> pending;
+    static std::vector<TextureJob *> ready;
+    static SDL_mutex *lock;
+    static SDL_cond *wake;
+    static SDL_cond *done;
+    static bool b_quit;
+
+    // only touched by the GL thread
+    static TextureJob *uploading;
+    static unsigned int num_outstanding;
+    static unsigned int num_loaded;
+    static Uint64 first_request;
+
+    static int WorkerMain(void *data);
+
+    // uploads the next level of job, true once it has replaced its fallback
+    static bool UploadStep(TextureJob *job);
+public:
+    static bool Init(void);
+
+    // drops anything not yet uploaded, the fallbacks stay bound
+    static void Destroy(void);
+
+    /* binds a fallback of colour rgba on texture_unit and writes it to *target now, the decoded
+     * texture replaces it on the same unit once Update has uploaded it
+     */
+    static void LoadTexture(const char *path, GLenum texture_unit, GLfloat aniso, const GLubyte rgba[4],
+                            GLuint *target, bool flip_x = false, bool flip_y = false);
+
+    // uploads ready textures for up to budget_ms, call once a frame on the GL thread
+    static void Update(double budget_ms = LOADER_FRAME_BUDGET_MS);
+
+    // blocks until every texture has been uploaded
+    static void Finish(void);
+
+    static inline bool IsIdle(void) { return num_outstanding == 0; }
+};
+
+#endif
@@ -0,0 +1,323 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "Benchmark.h"
+
+static void WriteStats(FILE *f, const char *indent, const char *name, std::vector<double> &values)
+{
+    if(values.empty())
+    {
+        fprintf(f, "%s\"%s\": null,\n", indent, name);
+        return;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    double sum = 0;
+    for(unsigned int i=0; i<values.size(); ++i) sum += values[i];
+
+    // nearest rank percentiles
+    const unsigned int percentiles[] = {50, 90, 95, 99};
+
+    fprintf(f, "%s\"%s\": {\"mean\": %.4f, \"min\": %.4f, \"max\": %.4f", indent, name,
+            sum / values.size(), values.front(), values.back());
+    for(unsigned int i=0; i<sizeof(percentiles) / sizeof(unsigned int); ++i)
+    {
+        size_t rank = (values.size() * percentiles[i] + 99) / 100;
+        fprintf(f, ", \"p%u\": %.4f", percentiles[i], values[rank > 0 ? rank - 1 : 0]);
+    }
+    fprintf(f, "},\n");
+}
+
+bool Benchmark::ParseArgs(int argc, const char **argv)
+{
+    for(int i=1; i<argc; ++i)
+    {
+        bool has_value = i + 1 < argc;
+
+        if(!strcmp(argv[i], "--bench"))
+        {
+            enabled = true;
+
+            // optional frame count
+            if(has_value && argv[i + 1][0] != '-') frames = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "--bench-seed") && has_value) seed = strtoul(argv[++i], NULL, 10);
+        else if(!strcmp(argv[i], "--bench-json") && has_value) json_path = argv[++i];
+        else if(!strcmp(argv[i], "--bench-dump") && has_value) dump_path = argv[++i];
+        else if(!strcmp(argv[i], "--bench-golden") && has_value) golden_path = argv[++i];
+        else if(!strcmp(argv[i], "--bench-trace") && has_value) trace_path = argv[++i];
+        else if(!strcmp(argv[i], "--bench-gpu-particles")) gpu_particles = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [--bench [frames]] [--bench-seed n] [--bench-json path]"
+                            " [--bench-dump path.bmp] [--bench-golden path.bmp] [--bench-trace path]"
+                            " [--bench-gpu-particles]\n", argv[0]);
+            return false;
+        }
+    }
+
+    if(enabled && frames == 0)
+    {
+        fprintf(stderr, "Benchmark::ParseArgs: error: frame count must be positive\n");
+        return false;
+    }
+
+    return true;
+}
+
+void Benchmark::Init(void)
+{
+    // pass times come from GpuProfiler, which must not drop frames here
+    GpuProfiler::b_wait = true;
+    GpuProfiler::SetCallback(OnGpuFrame, this);
+    gpu_first_frame = GpuProfiler::Frame() + 1;
+
+    if(!GpuProfiler::HasTimer()) fprintf(stderr, "Benchmark::Init: GPU times will be missing\n");
+
+    memset(stat_sums, 0, sizeof(stat_sums));
+    samples.reserve(frames);
+
+    fprintf(stderr, "Benchmark: %u frames, seed %u\n", frames, seed);
+}
+
+void Benchmark::BeginFrame(void)
+{
+    BenchFrame sample;
+    sample.cpu_ms = 0;
+    sample.gpu_ms = -1;
+    for(unsigned int p=0; p<NUM_GPU_PASSES; ++p) sample.pass_ms[p] = -1;
+    samples.push_back(sample);
+
+    frame_start = SDL_GetPerformanceCounter();
+}
+
+void Benchmark::EndFrame(void)
+{
+    Uint64 frame_end = SDL_GetPerformanceCounter();
+    samples.back().cpu_ms = (frame_end - frame_start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+void Benchmark::OnGpuFrame(void *user, unsigned int frame, const GpuPassResult *results)
+{
+    Benchmark *bench = (Benchmark *)user;
+
+    unsigned int index = frame - bench->gpu_first_frame;
+    if(frame < bench->gpu_first_frame || index >= bench->samples.size()) return;
+
+    BenchFrame *sample = &bench->samples[index];
+    sample->gpu_ms = 0;
+    for(unsigned int p=0; p<NUM_GPU_PASSES; ++p)
+    {
+        sample->pass_ms[p] = results[p].ms;
+        sample->gpu_ms += results[p].ms;
+
+        for(unsigned int s=0; s<NUM_GPU_STATS; ++s) bench->stat_sums[p][s] += results[p].stats[s];
+    }
+    ++bench->num_stat_frames;
+}
+
+void Benchmark::Camera(unsigned int frame, glm::vec3 *position, glm::quat *orientation)
+{
+    // one full orbit over the run, bobbing up and down twice
+    float t = (float)frame / frames;
+    float angle = t * 2 * 3.14159265f;
+    float height = 0.75f * sinf(angle * 2);
+
+    glm::vec3 eye(5 * sinf(angle), height, 5 * cosf(angle));
+
+    *orientation = glm::quat(glm::vec3(atan2f(height, 5.0f), -angle, 0));
+    *position = -eye;
+}
+
+#define GAME_DOMAIN "Benchmark::Capture"
+bool Benchmark::Capture(int width, int height)
+{
+    if(dump_path == NULL && golden_path == NULL) return true;
+
+    unsigned char *pixels = (unsigned char *)malloc(width * height * 3);
+
+    ASSERT_GL(glBindFramebuffer(GL_FRAMEBUFFER, 0))
+    ASSERT_GL(glReadBuffer(GL_BACK))
+    ASSERT_GL(glPixelStorei(GL_PACK_ALIGNMENT, 1))
+    ASSERT_GL(glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels))
+
+    // GL rows start at the bottom, BMP rows at the top
+    SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height, 24, 0x0000FF, 0x00FF00, 0xFF0000, 0);
+    for(int y=0; y<height; ++y)
+    {
+        memcpy((unsigned char *)surface->pixels + y * surface->pitch,
+               pixels + (height - 1 - y) * width * 3, width * 3);
+    }
+    free(pixels);
+
+    bool result = true;
+
+    if(dump_path != NULL && SDL_SaveBMP(surface, dump_path) != 0)
+    {
+        fprintf(stderr, "Benchmark::Capture: error: could not write `%s`: %s\n", dump_path, SDL_GetError());
+        result = false;
+    }
+
+    if(golden_path != NULL) result = Compare(surface) && result;
+
+    SDL_FreeSurface(surface);
+    return result;
+}
+#undef GAME_DOMAIN
+
+bool Benchmark::Compare(SDL_Surface *surface)
+{
+    SDL_Surface *loaded = SDL_LoadBMP(golden_path);
+    if(!loaded)
+    {
+        fprintf(stderr, "Benchmark::Compare: error: could not load `%s`: %s\n", golden_path, SDL_GetError());
+        return false;
+    }
+
+    SDL_Surface *golden = SDL_ConvertSurface(loaded, surface->format, 0);
+    SDL_FreeSurface(loaded);
+    if(!golden)
+    {
+        fprintf(stderr, "Benchmark::Compare: error: could not convert `%s`: %s\n", golden_path, SDL_GetError());
+        return false;
+    }
+
+    if(golden->w != surface->w || golden->h != surface->h)
+    {
+        fprintf(stderr, "Benchmark::Compare: error: golden image is %dx%d, frame is %dx%d\n",
+                golden->w, golden->h, surface->w, surface->h);
+        SDL_FreeSurface(golden);
+        return false;
+    }
+
+    b_compared = true;
+    golden_diff_pixels = 0;
+    golden_max_diff = 0;
+
+    for(int y=0; y<surface->h; ++y)
+    {
+        const unsigned char *a = (const unsigned char *)surface->pixels + y * surface->pitch;
+        const unsigned char *b = (const unsigned char *)golden->pixels + y * golden->pitch;
+
+        for(int x=0; x<surface->w; ++x)
+        {
+            unsigned int diff = 0;
+            for(int c=0; c<3; ++c)
+            {
+                diff = std::max(diff, (unsigned int)abs(a[x * 3 + c] - b[x * 3 + c]));
+            }
+
+            golden_max_diff = std::max(golden_max_diff, diff);
+            if(diff > BENCH_GOLDEN_TOLERANCE) ++golden_diff_pixels;
+        }
+    }
+
+    SDL_FreeSurface(golden);
+
+    fprintf(stderr, "Benchmark: %u pixels differ from `%s` (max difference %u)\n",
+            golden_diff_pixels, golden_path, golden_max_diff);
+    return golden_diff_pixels == 0;
+}
+
+#define GAME_DOMAIN "Benchmark::Finish"
+bool Benchmark::Finish(void)
+{
+    // the last few frames are still in flight
+    GpuProfiler::Flush();
+    GpuProfiler::SetCallback(NULL, NULL);
+
+    std::vector<double> cpu, gpu, pass[NUM_GPU_PASSES];
+    for(unsigned int i=0; i<samples.size(); ++i)
+    {
+        cpu.push_back(samples[i].cpu_ms);
+        if(samples[i].gpu_ms >= 0) gpu.push_back(samples[i].gpu_ms);
+
+        for(unsigned int p=0; p<NUM_GPU_PASSES; ++p)
+        {
+            if(samples[i].pass_ms[p] >= 0) pass[p].push_back(samples[i].pass_ms[p]);
+        }
+    }
+
+    FILE *f = fopen(json_path, "w");
+    if(!f)
+    {
+        fprintf(stderr, "Benchmark::Finish: error: could not open `%s`\n", json_path);
+        return false;
+    }
+
+    ASSERT_GL(const GLubyte *renderer = glGetString(GL_RENDERER))
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"renderer\": \"%s\",\n", renderer ? (const char *)renderer : "");
+    fprintf(f, "  \"frames\": %u,\n", (unsigned int)samples.size());
+    fprintf(f, "  \"seed\": %u,\n", seed);
+    fprintf(f, "  \"timestep\": %f,\n", timestep);
+    fprintf(f, "  \"particles\": \"%s\",\n", gpu_particles ? "gpu" : "cpu");
+
+    WriteStats(f, "  ", "cpu_ms", cpu);
+    WriteStats(f, "  ", "gpu_ms", gpu);
+
+    // per pass times, with pipeline statistics averaged per frame where supported
+    fprintf(f, "  \"passes\": {\n");
+    for(unsigned int p=0; p<NUM_GPU_PASSES; ++p)
+    {
+        fprintf(f, "    \"%s\": {\n", GpuProfiler::pass_names[p]);
+        WriteStats(f, "      ", "gpu_ms", pass[p]);
+
+        if(GpuProfiler::HasStats() && num_stat_frames > 0)
+        {
+            fprintf(f, "      \"stats\": {");
+            for(unsigned int s=0; s<NUM_GPU_STATS; ++s)
+            {
+                fprintf(f, "%s\"%s\": %.1f", s > 0 ? ", " : "", GpuProfiler::stat_names[s],
+                        stat_sums[p][s] / num_stat_frames);
+            }
+            fprintf(f, "}\n");
+        }
+        else fprintf(f, "      \"stats\": null\n");
+
+        fprintf(f, p + 1 < NUM_GPU_PASSES ? "    },\n" : "    }\n");
+    }
+    fprintf(f, "  },\n");
+
+    if(b_compared)
+    {
+        fprintf(f, "  \"golden\": {\"path\": \"%s\", \"diff_pixels\": %u, \"max_diff\": %u},\n",
+                golden_path, golden_diff_pixels, golden_max_diff);
+    }
+
+    fprintf(f, "  \"samples\": [\n");
+    for(unsigned int i=0; i<samples.size(); ++i)
+    {
+        fprintf(f, "    {\"cpu_ms\": %.4f, ", samples[i].cpu_ms);
+        if(samples[i].gpu_ms >= 0) fprintf(f, "\"gpu_ms\": %.4f}", samples[i].gpu_ms);
+        else fprintf(f, "\"gpu_ms\": null}");
+        fprintf(f, i + 1 < samples.size() ? ",\n" : "\n");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+
+    fprintf(stderr, "Benchmark: wrote `%s`\n", json_path);
+
+    return !b_compared || golden_diff_pixels == 0;
+}
+#undef GAME_DOMAIN
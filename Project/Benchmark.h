@@ -0,0 +1,92 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <vector>
+
+#include "common.h"
+#include "GpuProfiler.h"
+
+// golden images may differ by this much per channel before a pixel counts as changed
+#define BENCH_GOLDEN_TOLERANCE 2
+
+struct BenchFrame
+{
+    double cpu_ms;
+    double gpu_ms;      // negative until the query result arrives, or without timer queries
+    double pass_ms[NUM_GPU_PASSES];
+};
+
+class Benchmark
+{
+protected:
+    Uint64 frame_start;
+
+    std::vector<BenchFrame> samples;
+
+    // GpuProfiler frame number of the first sample
+    unsigned int gpu_first_frame;
+
+    // pipeline statistics summed over every frame
+    double stat_sums[NUM_GPU_PASSES][NUM_GPU_STATS];
+    unsigned int num_stat_frames;
+
+    // image comparison results
+    bool b_compared;
+    unsigned int golden_diff_pixels;
+    unsigned int golden_max_diff;
+
+    static void OnGpuFrame(void *user, unsigned int frame, const GpuPassResult *results);
+    bool Compare(SDL_Surface *surface);
+public:
+    bool enabled;
+    unsigned int frames;
+    unsigned int seed;
+    float timestep;
+
+    // simulate particles with transform feedback
+    bool gpu_particles;
+
+    const char *json_path;
+    const char *dump_path;
+    const char *golden_path;
+    const char *trace_path;
+
+    Benchmark() : gpu_first_frame(0), num_stat_frames(0), b_compared(false), golden_diff_pixels(0), golden_max_diff(0),
+                  enabled(false), frames(600), seed(1), timestep(1.0f / 60.0f), gpu_particles(false),
+                  json_path("bench.json"), dump_path(NULL), golden_path(NULL),
+                  trace_path("bench_trace.json") {}
+
+    // picks up --bench and its options, returns false on a malformed command line
+    bool ParseArgs(int argc, const char **argv);
+
+    void Init(void);
+    void BeginFrame(void);
+    void EndFrame(void);
+
+    // scripted camera path, a slow orbit around the scene
+    void Camera(unsigned int frame, glm::vec3 *position, glm::quat *orientation);
+
+    // reads the back buffer, writes it out and compares it against the golden image
+    bool Capture(int width, int height);
+
+    // returns false if the golden comparison failed
+    bool Finish(void);
+};
+
+#endif
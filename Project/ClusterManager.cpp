@@ -0,0 +1,234 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <float.h>
+
+#include "ClusterManager.h"
+
+ShaderProgram *ClusterManager::program;
+
+GLuint ClusterManager::tbo_grid;
+GLuint ClusterManager::tbo_lights;
+GLuint ClusterManager::tex_grid;
+GLuint ClusterManager::tex_lights;
+
+float ClusterManager::z_near;
+float ClusterManager::z_far;
+float ClusterManager::slice_scale;
+
+float ClusterManager::tan_x;
+float ClusterManager::tan_y;
+
+ClusterBounds ClusterManager::bounds[CLUSTER_TOTAL];
+
+GLuint ClusterManager::grid[CLUSTER_TOTAL * 2];
+std::vector<GLushort> ClusterManager::indices;
+
+float ClusterManager::LightRadius(const LightType *type)
+{
+    float intensity = fmax(fmax(fmax(type->vDiffuse.x, type->vDiffuse.y), type->vDiffuse.z),
+                           fmax(fmax(type->vSpecular.x, type->vSpecular.y), type->vSpecular.z));
+
+    // solve c + l*d + q*d^2 = intensity / threshold for d
+    float c = type->fAttenuationConst - intensity / CLUSTER_LIGHT_THRESHOLD;
+    float l = type->fAttenuationLinear;
+    float q = type->fAttenuationQuadratic;
+
+    if(c >= 0) return 0;
+    if(q > 0) return (-l + sqrtf(l * l - 4 * q * c)) / (2 * q);
+    if(l > 0) return -c / l;
+
+    // no attenuation, the light reaches every cluster
+    return FLT_MAX;
+}
+
+#define GAME_DOMAIN "ClusterManager::Init"
+void ClusterManager::Init(ShaderProgram *program)
+{
+    ClusterManager::program = program;
+
+    ASSERT_GL(glGenBuffers(1, &tbo_grid))
+    ASSERT_GL(glBindBuffer(GL_TEXTURE_BUFFER, tbo_grid))
+    ASSERT_GL(glBufferData(GL_TEXTURE_BUFFER, sizeof(grid), NULL, GL_STREAM_DRAW))
+
+    ASSERT_GL(glGenBuffers(1, &tbo_lights))
+    ASSERT_GL(glBindBuffer(GL_TEXTURE_BUFFER, tbo_lights))
+    ASSERT_GL(glBufferData(GL_TEXTURE_BUFFER, sizeof(GLushort), NULL, GL_STREAM_DRAW))
+    ASSERT_GL(glBindBuffer(GL_TEXTURE_BUFFER, 0))
+
+    ASSERT_GL(glActiveTexture(GL_TEXTURE0 + CLUSTER_UNIT_GRID))
+    ASSERT_GL(glGenTextures(1, &tex_grid))
+    ASSERT_GL(glBindTexture(GL_TEXTURE_BUFFER, tex_grid))
+    ASSERT_GL(glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, tbo_grid))
+
+    ASSERT_GL(glActiveTexture(GL_TEXTURE0 + CLUSTER_UNIT_LIGHTS))
+    ASSERT_GL(glGenTextures(1, &tex_lights))
+    ASSERT_GL(glBindTexture(GL_TEXTURE_BUFFER, tex_lights))
+    ASSERT_GL(glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, tbo_lights))
+
+    ASSERT_GL(glActiveTexture(GL_TEXTURE0))
+
+    program->SetUniform1i(UNIFORM_S_CLUSTERS, CLUSTER_UNIT_GRID);
+    program->SetUniform1i(UNIFORM_S_CLUSTERLIGHTS, CLUSTER_UNIT_LIGHTS);
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ClusterManager::SetProjection"
+void ClusterManager::SetProjection(float fovy, float aspect, float z_near, float z_far, float width, float height)
+{
+    ClusterManager::z_near = z_near;
+    ClusterManager::z_far = z_far;
+    slice_scale = CLUSTER_Z / logf(z_far / z_near);
+
+    tan_y = tanf(glm::radians(fovy) * 0.5f);
+    tan_x = tan_y * aspect;
+
+    for(int z=0; z<CLUSTER_Z; ++z)
+    {
+        // exponential depth slices
+        float z0 = z_near * powf(z_far / z_near, (float)z / CLUSTER_Z);
+        float z1 = z_near * powf(z_far / z_near, (float)(z + 1) / CLUSTER_Z);
+
+        for(int y=0; y<CLUSTER_Y; ++y)
+        {
+            float y0 = (-1 + 2.0f * y / CLUSTER_Y) * tan_y;
+            float y1 = (-1 + 2.0f * (y + 1) / CLUSTER_Y) * tan_y;
+
+            for(int x=0; x<CLUSTER_X; ++x)
+            {
+                float x0 = (-1 + 2.0f * x / CLUSTER_X) * tan_x;
+                float x1 = (-1 + 2.0f * (x + 1) / CLUSTER_X) * tan_x;
+
+                ClusterBounds *b = &bounds[x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y];
+                b->vMin = glm::vec3(fmin(x0 * z0, x0 * z1), fmin(y0 * z0, y0 * z1), -z1);
+                b->vMax = glm::vec3(fmax(x1 * z0, x1 * z1), fmax(y1 * z0, y1 * z1), -z0);
+            }
+        }
+    }
+
+    program->SetUniform2f(UNIFORM_V_SCREENSIZE, width, height);
+    program->SetUniform1f(UNIFORM_F_CLUSTERSCALE, slice_scale);
+    program->SetUniform1f(UNIFORM_F_CLUSTERBIAS, -logf(z_near) * slice_scale);
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ClusterManager::Build"
+void ClusterManager::Build(const glm::mat4 &matCamera)
+{
+    PROFILE_ZONE("ClusterManager::Build");
+
+    // (cluster, light) pairs, counted per cluster
+    static std::vector<GLuint> pairs;
+    pairs.clear();
+    memset(grid, 0, sizeof(grid));
+
+    float radii[NUM_LIGHT_TYPES];
+    for(unsigned int i=0; i<NUM_LIGHT_TYPES; ++i)
+    {
+        radii[i] = LightRadius(&LightingManager::light_types[i]);
+    }
+
+    /* ambient light does not attenuate, so it is summed here instead of per
+     * cluster to keep the result independent of culling
+     */
+    glm::vec3 vAmbient(0);
+
+    for(unsigned int i=0; i<NUM_LIGHTS; ++i)
+    {
+        Light *light = &LightingManager::lights[i];
+        if(!light->bActive) continue;
+
+        vAmbient += glm::vec3(LightingManager::light_types[light->nType].vAmbient);
+
+        float r = radii[light->nType];
+        if(r <= 0) continue;
+
+        glm::vec3 p = glm::vec3(matCamera * glm::vec4(glm::vec3(light->vPosition), 1));
+
+        float d0 = -p.z - r;
+        float d1 = -p.z + r;
+        if(d1 < z_near || d0 > z_far) continue;
+
+        d0 = fmax(d0, z_near);
+        d1 = fmin(d1, z_far);
+
+        int z0 = Slice(d0);
+        int z1 = Slice(d1);
+
+        // conservative screen space extent of the sphere over its depth range
+        int x0 = 0, x1 = CLUSTER_X - 1;
+        int y0 = 0, y1 = CLUSTER_Y - 1;
+        if(r < FLT_MAX)
+        {
+            float nx0 = fmin((p.x - r) / (d0 * tan_x), (p.x - r) / (d1 * tan_x));
+            float nx1 = fmax((p.x + r) / (d0 * tan_x), (p.x + r) / (d1 * tan_x));
+            float ny0 = fmin((p.y - r) / (d0 * tan_y), (p.y - r) / (d1 * tan_y));
+            float ny1 = fmax((p.y + r) / (d0 * tan_y), (p.y + r) / (d1 * tan_y));
+            if(nx1 < -1 || nx0 > 1 || ny1 < -1 || ny0 > 1) continue;
+
+            x0 = Tile(nx0, CLUSTER_X);
+            x1 = Tile(nx1, CLUSTER_X);
+            y0 = Tile(ny0, CLUSTER_Y);
+            y1 = Tile(ny1, CLUSTER_Y);
+        }
+
+        for(int z=z0; z<=z1; ++z)
+        {
+            for(int y=y0; y<=y1; ++y)
+            {
+                for(int x=x0; x<=x1; ++x)
+                {
+                    unsigned int c = x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y;
+
+                    // sphere against cluster box
+                    glm::vec3 vClosest = glm::clamp(p, bounds[c].vMin, bounds[c].vMax);
+                    glm::vec3 vDelta = vClosest - p;
+                    if(r < FLT_MAX && glm::dot(vDelta, vDelta) > r * r) continue;
+
+                    pairs.push_back(c);
+                    pairs.push_back(i);
+                    ++grid[c * 2 + 1];
+                }
+            }
+        }
+    }
+
+    // prefix sum of the counts gives each cluster its offset
+    GLuint offset = 0;
+    for(unsigned int c=0; c<CLUSTER_TOTAL; ++c)
+    {
+        grid[c * 2] = offset;
+        offset += grid[c * 2 + 1];
+        grid[c * 2 + 1] = 0;
+    }
+
+    indices.resize(offset > 0 ? offset : 1);
+    for(unsigned int p=0; p<pairs.size(); p+=2)
+    {
+        GLuint c = pairs[p];
+        indices[grid[c * 2] + grid[c * 2 + 1]++] = (GLushort)pairs[p + 1];
+    }
+
+    // orphan and refill both buffers
+    ASSERT_GL(glBindBuffer(GL_TEXTURE_BUFFER, tbo_grid))
+    ASSERT_GL(glBufferData(GL_TEXTURE_BUFFER, sizeof(grid), grid, GL_STREAM_DRAW))
+    ASSERT_GL(glBindBuffer(GL_TEXTURE_BUFFER, tbo_lights))
+    ASSERT_GL(glBufferData(GL_TEXTURE_BUFFER, indices.size() * sizeof(GLushort), &indices[0], GL_STREAM_DRAW))
+    ASSERT_GL(glBindBuffer(GL_TEXTURE_BUFFER, 0))
+
+    program->SetUniform3fv(UNIFORM_V_LIGHTAMBIENT, 1, glm::value_ptr(vAmbient));
+}
+#undef GAME_DOMAIN
@@ -0,0 +1,93 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CLUSTERMANAGER_H
+#define CLUSTERMANAGER_H
+
+#include <vector>
+
+#include "common.h"
+#include "LightingManager.h"
+#include "ShaderProgram.h"
+
+// must match the constants in shader.fsh
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_TOTAL (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+// texture units used for the cluster buffer textures
+#define CLUSTER_UNIT_GRID 7
+#define CLUSTER_UNIT_LIGHTS 8
+
+/* a light stops influencing a cluster once its attenuated intensity, its brightest colour
+ * component over the attenuation, drops below this absolute value
+ */
+#define CLUSTER_LIGHT_THRESHOLD (1.0f / 256.0f)
+
+struct ClusterBounds
+{
+    glm::vec3 vMin;
+    glm::vec3 vMax;
+};
+
+class ClusterManager
+{
+protected:
+    static ShaderProgram *program;
+
+    static GLuint tbo_grid;
+    static GLuint tbo_lights;
+    static GLuint tex_grid;
+    static GLuint tex_lights;
+
+    static float z_near;
+    static float z_far;
+    static float slice_scale;
+
+    // half extents of the view frustum at a depth of 1
+    static float tan_x;
+    static float tan_y;
+
+    // view space bounding box of every cluster
+    static ClusterBounds bounds[CLUSTER_TOTAL];
+
+    // per cluster (offset, count) into the light index list
+    static GLuint grid[CLUSTER_TOTAL * 2];
+    static std::vector<GLushort> indices;
+
+    static inline int Slice(float depth)
+    {
+        int k = (int)(logf(depth / z_near) * slice_scale);
+        return k < 0 ? 0 : (k >= CLUSTER_Z ? CLUSTER_Z - 1 : k);
+    }
+
+    static inline int Tile(float ndc, int tiles)
+    {
+        int t = (int)((ndc * 0.5f + 0.5f) * tiles);
+        return t < 0 ? 0 : (t >= tiles ? tiles - 1 : t);
+    }
+public:
+    static float LightRadius(const LightType *type);
+
+    static void Init(ShaderProgram *program);
+    static void SetProjection(float fovy, float aspect, float z_near, float z_far, float width, float height);
+
+    // bin every active light into the cluster grid and upload the result
+    static void Build(const glm::mat4 &matCamera);
+};
+
+#endif
@@ -152,9 +152,9 @@ protected:
     }
 public:
 #define GAME_DOMAIN "CubeDrawable::Draw"
-    virtual void Draw(GLuint program_id, GLint u_matModelView, glm::mat4 matModelView)
+    virtual void Draw(ShaderProgram *program, glm::mat4 matModelView)
     {
-        Drawable::Draw(program_id, u_matModelView, matModelView);
+        Drawable::Draw(program, matModelView);
 
         const GLint firsts[] = {0, 4, 8, 12, 16, 20};
         const GLint counts[] = {4, 4, 4, 4, 4, 4};
@@ -19,6 +19,7 @@
 
 #include "common.h"
 #include "LightingManager.h"
+#include "ShaderProgram.h"
 
 class Drawable
 {
@@ -65,25 +66,43 @@ public:
     }
 #undef GAME_DOMAIN
 
+#define GAME_DOMAIN "Drawable::StreamBuffer"
+    /* orphans the old storage so the driver never waits for draws still
+     * reading it, then fills the first size bytes
+     */
+    static void StreamBuffer(GLuint vbo, GLenum target, GLsizeiptr capacity, GLsizeiptr size, const GLvoid *data)
+    {
+        ASSERT_GL(glBindBuffer(target, vbo))
+        ASSERT_GL(glBufferData(target, capacity, NULL, GL_STREAM_DRAW))
+        ASSERT_GL(glBufferSubData(target, 0, size, data))
+    }
+#undef GAME_DOMAIN
+
 #define GAME_DOMAIN "Drawable::MakeVBO"
-    static GLuint MakeVBO(GLsizeiptr size, const GLvoid *data, GLuint program_id,
-                         const GLchar *attrib_name, GLint attrib_size, GLenum attrib_type,
+    static GLuint MakeVBO(GLsizeiptr size, const GLvoid *data, ShaderProgram *program,
+                         ShaderAttrib attrib, GLint attrib_size, GLenum attrib_type,
                          GLenum usage)
     {
         GLuint vbo = Drawable::MakeBuffer(GL_ARRAY_BUFFER, size, data, usage);
-        EnableAttrib(program_id, attrib_name, attrib_size, attrib_type);
+        EnableAttrib(program, attrib, attrib_size, attrib_type);
 
         return vbo;
     }
 #undef GAME_DOMAIN
 
 #define GAME_DOMAIN "Drawable::EnableAttrib"
-    static void EnableAttrib(GLuint program_id, const GLchar *attrib_name, GLint attrib_size, GLenum attrib_type)
+    static void EnableAttrib(ShaderProgram *program, ShaderAttrib attrib, GLint attrib_size, GLenum attrib_type,
+                             GLsizei stride = 0, size_t offset = 0)
     {
-        ASSERT_GL(GLint attrib_id = glGetAttribLocation(program_id, attrib_name))
-        if(attrib_id < 0) fprintf(stderr, "Drawable::make_vbo: attribute \"%s\" is not active in program\n", attrib_name);
-
-        ASSERT_GL(glVertexAttribPointer(attrib_id, attrib_size, attrib_type, GL_FALSE, 0, NULL))
+        GLint attrib_id = program->Attrib(attrib);
+        if(attrib_id < 0)
+        {
+            fprintf(stderr, "Drawable::EnableAttrib: attribute \"%s\" is not active in program\n",
+                    ShaderProgram::attrib_names[attrib]);
+            return;
+        }
+
+        ASSERT_GL(glVertexAttribPointer(attrib_id, attrib_size, attrib_type, GL_FALSE, stride, (const GLvoid *)offset))
         ASSERT_GL(glEnableVertexAttribArray(attrib_id))
     }
 #undef GAME_DOMAIN
@@ -94,18 +113,18 @@ public:
     Drawable(GLenum usage = GL_STATIC_DRAW) : usage(usage), material_id(0), position(glm::vec3(0)) {}
 
 #define GAME_DOMAIN "Drawable::Init"
-    void Init(GLuint program_id)
+    void Init(ShaderProgram *program)
     {
         unsigned int num = Make(&vertices, &normals, &tangents, &bitangents, &texcoords);
 
         ASSERT_GL(glGenVertexArrays(1, &this->vao))
         Bind();
 
-        vbo_vertex    = MakeVBO(num * sizeof(glm::vec3), vertices,   program_id, "a_vVertex",    3, GL_FLOAT, usage);
-        vbo_normal    = MakeVBO(num * sizeof(glm::vec3), normals,    program_id, "a_vNormal",    3, GL_FLOAT, usage);
-        vbo_tangent   = MakeVBO(num * sizeof(glm::vec3), tangents,   program_id, "a_vTangent",   3, GL_FLOAT, usage);
-        vbo_bitangent = MakeVBO(num * sizeof(glm::vec3), bitangents, program_id, "a_vBitangent", 3, GL_FLOAT, usage);
-        vbo_texcoord  = MakeVBO(num * sizeof(glm::vec2), texcoords,  program_id, "a_vTexCoord",  2, GL_FLOAT, usage);
+        vbo_vertex    = MakeVBO(num * sizeof(glm::vec3), vertices,   program, ATTRIB_VERTEX,    3, GL_FLOAT, usage);
+        vbo_normal    = MakeVBO(num * sizeof(glm::vec3), normals,    program, ATTRIB_NORMAL,    3, GL_FLOAT, usage);
+        vbo_tangent   = MakeVBO(num * sizeof(glm::vec3), tangents,   program, ATTRIB_TANGENT,   3, GL_FLOAT, usage);
+        vbo_bitangent = MakeVBO(num * sizeof(glm::vec3), bitangents, program, ATTRIB_BITANGENT, 3, GL_FLOAT, usage);
+        vbo_texcoord  = MakeVBO(num * sizeof(glm::vec2), texcoords,  program, ATTRIB_TEXCOORD,  2, GL_FLOAT, usage);
     }
 #undef GAME_DOMAIN
 
@@ -117,12 +136,12 @@ public:
 #undef GAME_DOMAIN
 
 #define GAME_DOMAIN "Drawable::Draw"
-    virtual void Draw(GLuint program_id, GLint u_matModelView, glm::mat4 matModelView)
+    virtual void Draw(ShaderProgram *program, glm::mat4 matModelView)
     {
-        LightingManager::SetMaterial(program_id, material_id);
+        LightingManager::SetMaterial(program, material_id);
 
         matModelView = glm::translate(matModelView, position);
-        ASSERT_GL(glUniformMatrix4fv(u_matModelView, 1, GL_FALSE, glm::value_ptr(matModelView)))
+        ASSERT_GL(glUniformMatrix4fv(program->Uniform(UNIFORM_MAT_MODELVIEW), 1, GL_FALSE, glm::value_ptr(matModelView)))
 
         Bind();
     }
@@ -0,0 +1,82 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string.h>
+
+#include "GLDebug.h"
+
+const char *GLDebug::domain = "";
+const char *GLDebug::call = "";
+bool GLDebug::b_callback = false;
+
+#if defined(GL_KHR_debug) && !defined(NDEBUG)
+static void GLAPIENTRY DebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                     GLsizei length, const GLchar *message, GLvoid *user)
+{
+    GLDebug::Report(source, type, id, severity, message);
+}
+#endif
+
+void GLDebug::Report(GLenum source, GLenum type, GLuint id, GLenum severity, const GLchar *message)
+{
+#if defined(GL_KHR_debug)
+    // skip the chatter about buffer placement and the like
+    if(severity == GL_DEBUG_SEVERITY_NOTIFICATION) return;
+
+    if(type == GL_DEBUG_TYPE_ERROR)
+    {
+        fprintf(stderr, "OpenGL error 0x%x\n  » %s\n    » %s\n      » %s\n", id, domain, call, message);
+    }
+    else fprintf(stderr, "OpenGL debug 0x%x (type 0x%x)\n  » %s\n    » %s\n      » %s\n", id, type, domain, call, message);
+#endif
+}
+
+#define GAME_DOMAIN "GLDebug::Init"
+bool GLDebug::Init(void)
+{
+#if defined(GL_KHR_debug) && !defined(NDEBUG)
+#if defined(_WIN32) || defined(__linux__)
+    if(!GLEW_KHR_debug) return false;
+#endif
+
+    // synchronous output runs the callback inside the failing call
+    ASSERT_GL(glEnable(GL_DEBUG_OUTPUT))
+    ASSERT_GL(glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS))
+    ASSERT_GL(glDebugMessageCallback(DebugCallback, NULL))
+    ASSERT_GL(glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE))
+
+    b_callback = true;
+    fprintf(stderr, "GLDebug: using KHR_debug callback\n");
+    return true;
+#else
+    return false;
+#endif
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "GLDebug::HasExtension"
+bool GLDebug::HasExtension(const char *name)
+{
+    GLint num_extensions = 0;
+    ASSERT_GL(glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions))
+    for(GLint i=0; i<num_extensions; ++i)
+    {
+        ASSERT_GL(const GLubyte *extension = glGetStringi(GL_EXTENSIONS, i))
+        if(extension && !strcmp((const char *)extension, name)) return true;
+    }
+    return false;
+}
+#undef GAME_DOMAIN
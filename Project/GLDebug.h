@@ -0,0 +1,60 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef GLDEBUG_H
+#define GLDEBUG_H
+
+#include <stdio.h>
+
+#include "common.h"
+
+class GLDebug
+{
+protected:
+    // the GL call currently inside ASSERT_GL
+    static const char *domain;
+    static const char *call;
+
+    // true once the KHR_debug callback is installed
+    static bool b_callback;
+public:
+    // call once the context is current, returns whether KHR_debug is in use
+    static bool Init(void);
+
+    // whether the context lists the extension, for those GLEW does not know yet
+    static bool HasExtension(const char *name);
+
+    static inline void Enter(const char *domain, const char *call)
+    {
+        GLDebug::domain = domain;
+        GLDebug::call = call;
+
+        // clear stale errors so they are not blamed on this call
+        if(!b_callback) glGetError();
+    }
+
+    static inline void Leave(void)
+    {
+        if(b_callback) return;
+
+        GLenum err = glGetError();
+        if(err != GL_NO_ERROR) fprintf(stderr, "OpenGL error 0x%x\n  » %s\n    » %s\n", err, domain, call);
+    }
+
+    static void Report(GLenum source, GLenum type, GLuint id, GLenum severity, const GLchar *message);
+};
+
+#endif
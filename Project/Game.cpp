@@ -16,40 +16,6 @@
 
 #include "Game.h"
 
-#define GAME_DOMAIN "Game::PrintShaderError"
-void Game::PrintShaderError(GLint shader)
-{
-    GLint max_len = 0;
-    GLint log_len = 0;
-    ASSERT_GL(unsigned char is_shader = glIsShader(shader))
-
-    if(is_shader)
-    {
-        ASSERT_GL(glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &max_len))
-    }
-    else
-    {
-        ASSERT_GL(glGetProgramiv(shader, GL_INFO_LOG_LENGTH, &max_len))
-    }
-
-    if(max_len <= 0) return;
-
-    GLchar *message = (GLchar *)malloc(sizeof(GLchar) * max_len);
-
-    if(is_shader)
-    {
-        ASSERT_GL(glGetShaderInfoLog(shader, max_len, &log_len, message))
-    }
-    else
-    {
-        ASSERT_GL(glGetProgramInfoLog(shader, max_len, &log_len, message))
-    }
-
-    fprintf(stderr, "%s\n", message);
-    free(message);
-}
-#undef GAME_DOMAIN
-
 #define GAME_DOMAIN "Game::InitSDL"
 bool Game::InitSDL(void)
 {
@@ -87,6 +53,9 @@ bool Game::InitSDL(void)
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+#ifndef NDEBUG
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+#endif
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
     SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
     SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 8);
@@ -99,7 +68,7 @@ bool Game::InitSDL(void)
     this->wnd = SDL_CreateWindow("Game",
                                  SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
                                  this->width, this->height,
-                                 SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+                                 SDL_WINDOW_OPENGL | (bench.enabled ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE));
     if(!this->wnd)
     {
         fprintf(stderr, "SDL_CreateWindow: error: %s\n", SDL_GetError());
@@ -117,8 +86,8 @@ bool Game::InitSDL(void)
     ASSERT_GL(fprintf(stderr, "OpenGL version: %s\n", glGetString(GL_VERSION)))
     ASSERT_GL(fprintf(stderr, "GLSL version: %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION)))
 
-    // enable vsync
-    SDL_GL_SetSwapInterval(1);
+    // enable vsync, except when benchmarking
+    SDL_GL_SetSwapInterval(bench.enabled ? 0 : 1);
 
     return true;
 }
@@ -138,68 +107,8 @@ bool Game::InitGLEW(void)
     }
 #endif
 
-    return true;
-}
-#undef GAME_DOMAIN
-
-#define GAME_DOMAIN "Game::InitShaders"
-bool Game::InitShaders(const char *v_path, const char *f_path, GLuint *program)
-{
-    long v_len, f_len;
-    const char *v_src = ResourceManager::Load(v_path, &v_len);
-    const char *f_src = ResourceManager::Load(f_path, &f_len);
-
-    if(v_src == NULL)
-    {
-        fprintf(stderr, "::InitShaders: error: failed to load vertex shader\n");
-        return false;
-    }
-
-    if(f_src == NULL)
-    {
-        fprintf(stderr, "::InitShaders: error: failed to load fragment shader\n");
-        return false;
-    }
-
-    ASSERT_GL(GLuint v_id = glCreateShader(GL_VERTEX_SHADER))
-    ASSERT_GL(GLuint f_id = glCreateShader(GL_FRAGMENT_SHADER))
-
-    ASSERT_GL(glShaderSource(v_id, 1, &v_src, (GLint *)&v_len))
-    ASSERT_GL(glShaderSource(f_id, 1, &f_src, (GLint *)&f_len))
-
-    GLint compile_status;
-
-    ASSERT_GL(glCompileShader(v_id))
-    ASSERT_GL(glGetShaderiv(v_id, GL_COMPILE_STATUS, &compile_status))
-    if(!compile_status)
-    {
-        fprintf(stderr, "glCompileShader(v_id): error in `%s`\n", f_path);
-        this->PrintShaderError(v_id);
-        return false;
-    }
-
-    ASSERT_GL(glCompileShader(f_id))
-    ASSERT_GL(glGetShaderiv(f_id, GL_COMPILE_STATUS, &compile_status))
-    if(!compile_status)
-    {
-        fprintf(stderr, "glCompileShader(f_id): error `%s`\n", f_path);
-        this->PrintShaderError(f_id);
-        return false;
-    }
-
-    ASSERT_GL(*program = glCreateProgram())
-    ASSERT_GL(glAttachShader(*program, v_id))
-    ASSERT_GL(glAttachShader(*program, f_id))
-
-    //ASSERT_GL(glBindAttribLocation(*program, GAME_ATTRIB_VERTEX, "a_vVertex"))
-    //ASSERT_GL(glBindAttribLocation(*program, GAME_ATTRIB_NORMAL, "a_vNormal"))
-    //ASSERT_GL(glBindAttribLocation(*program, GAME_ATTRIB_TEXCOORD, "a_vTexCoord"))
-
-    ASSERT_GL(glLinkProgram(*program))
-    ASSERT_GL(glUseProgram(*program))
-
-	// fixes viewport starting at the wrong size
-	ASSERT_GL(glViewport(0, 0, width, height))
+    // route GL errors through KHR_debug instead of polling glGetError
+    GLDebug::Init();
 
     return true;
 }
@@ -215,8 +124,13 @@ bool Game::DestroySDL(void)
 #define GAME_DOMAIN "Game::Init"
 bool Game::Init(void)
 {
-    // init random
-    srand((unsigned int)time(NULL));
+    Profiler::Init();
+    PROFILE_ZONE("Game::Init");
+
+    // init random, benchmarks use a fixed seed
+    unsigned int seed = bench.enabled ? bench.seed : (unsigned int)time(NULL);
+    srand(seed);
+    particles.Seed(seed);
 
     // initial states
     b_hdr = false;
@@ -228,13 +142,55 @@ bool Game::Init(void)
     this->width = 1280;
     this->height = 720;
 
+    if(ResourceManager::Mount(GAME_ASSET_ARCHIVE)) printf("Assets: mounted `%s`\n", GAME_ASSET_ARCHIVE);
+
     if(!this->InitSDL()) return false;
     if(!this->InitGLEW()) return false;
-    if(!this->InitShaders("shader.vsh", "shader.fsh", &program_id)) return false;
-    ASSERT_GL(loc_u_bHDR = glGetUniformLocation(program_id, "u_bHDR"))
-    ASSERT_GL(glProgramUniform1i(program_id, loc_u_bHDR, b_hdr))
+    ShaderProgram::Init();
+
+    // without binary support every program is built from source as before
+    ProgramCache::Init(GAME_PROGRAM_CACHE);
+
+    // every program is handed to the driver at once, the textures start loading while it compiles
+    ShaderBuilder shaders;
+    int main_index = shaders.Add("shader.vsh", "shader.fsh");
+    int particles_index = shaders.Add("particles.vsh", NULL, ParticlesDrawable::feedback_varyings,
+                                      ParticlesDrawable::num_feedback_varyings, ParticlesDrawable::sim_attribs,
+                                      ParticlesDrawable::num_sim_attribs);
+    int bloom_index = shaders.Add("postproc_bloom.vsh", "postproc_bloom.fsh");
+    int motionblur_index = shaders.Add("postproc_motionblur.vsh", "postproc_motionblur.fsh");
+    shaders.Submit();
 
-    LightingManager::Init(program_id);
+    // max anisotropy
+    GLfloat aniso;
+    ASSERT_GL(glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &aniso))
+
+    // load textures on the loader, flat stand-ins are drawn until each one is uploaded
+    static const GLubyte grey[4] = { 128, 128, 128, 255 };
+    static const GLubyte flat_normal[4] = { 128, 128, 255, 255 };
+    if(!AssetLoader::Init()) return false;
+    AssetLoader::LoadTexture("stone.bmp", GL_TEXTURE0, aniso, grey, &this->tex);
+    AssetLoader::LoadTexture("four_NM_height.bmp", GL_TEXTURE1, aniso, flat_normal, &this->nmap, false, true);
+    AssetLoader::LoadTexture("stone_gloss.bmp", GL_TEXTURE2, aniso, grey, &this->glossmap);
+    AssetLoader::LoadTexture("stone_normal.bmp", GL_TEXTURE3, aniso, flat_normal, &this->nmap2);
+
+    // the particle program may fail, the CPU backend is kept without it
+    shaders.Finish();
+    if(!shaders.Get(main_index) || !shaders.Get(bloom_index) || !shaders.Get(motionblur_index)) return false;
+    program = shaders.Take(main_index);
+    program_particles = shaders.Take(particles_index);
+    program_bloom = shaders.Take(bloom_index);
+    program_motionblur = shaders.Take(motionblur_index);
+
+    ASSERT_GL(glUseProgram(program->id))
+
+	// fixes viewport starting at the wrong size
+	ASSERT_GL(glViewport(0, 0, width, height))
+
+    program->SetUniform1i(UNIFORM_B_HDR, b_hdr);
+
+    GpuProfiler::Init();
+    LightingManager::Init(program);
 
     //LightingManager::light_types[0].vDiffuse = glm::vec4(1, 0, 0, 1);
     LightingManager::light_types[0].vDiffuse = glm::vec4(1, 0.8f, 0, 1);
@@ -271,18 +227,30 @@ bool Game::Init(void)
     LightingManager::materials[1].fShininess = 16;
     LightingManager::materials[1].vDiffuse = glm::vec4(1, 0.9f, 0.7f, 1);
 
-    LightingManager::UploadAll(this->program_id);
+    LightingManager::UploadAll();
 
-    cube_left.Init(program_id);
+    ClusterManager::Init(program);
+
+    cube_left.Init(program);
     cube_left.position = glm::vec3(-2.0f, 0, 0);
 
-    cube_right.Init(program_id);
+    cube_right.Init(program);
     cube_right.position = glm::vec3(2.0f, 0, 0);
     cube_right.material_id = 1;
 
-    particles.Init(program_id);
+    particles.Init(program);
+    // lights 0-4 belong to the scene
+    particles.SetLights(5, NUM_LIGHTS);
     particles.b_create = b_particles_create;
 
+    // the CPU backend is kept if the simulation program is unavailable
+    if(!particles.InitGpu(program, program_particles))
+    {
+        fprintf(stderr, "Game::Init: GPU particles unavailable\n");
+        bench.gpu_particles = false;
+    }
+    else if(bench.gpu_particles) particles.SetGpu(true);
+
     ASSERT_GL(glEnable(GL_DEPTH_TEST))
     ASSERT_GL(glEnable(GL_CULL_FACE))
     ASSERT_GL(glCullFace(GL_BACK))
@@ -295,29 +263,20 @@ bool Game::Init(void)
     this->position = glm::vec3(0.0f, 0.0f, -5.0f);
     //this->camera = glm::translate(this->matIdentity, glm::vec3(0.0f, 0.0f, -5.0f));
 
-    // max anisotropy
-    GLfloat aniso;
-    ASSERT_GL(glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &aniso))
-
-    // load textures
-    this->tex = TextureManager::LoadBMP("stone.bmp", GL_TEXTURE0, aniso);
-    this->nmap = TextureManager::LoadBMP("four_NM_height.bmp", GL_TEXTURE1, aniso, false, true);
-    this->glossmap = TextureManager::LoadBMP("stone_gloss.bmp", GL_TEXTURE2, aniso);
-    TextureManager::LoadBMP("stone_normal.bmp", GL_TEXTURE3, aniso);
-
-    // bind texture units to shader samplers
-    ASSERT_GL(glUniform1i(glGetUniformLocation(this->program_id, "u_sDiffuse"), 0))
-    ASSERT_GL(glUniform1i(glGetUniformLocation(this->program_id, "u_sNormalHeight"), 1))
-    ASSERT_GL(glUniform1i(glGetUniformLocation(this->program_id, "u_sSpecular"), 2))
-    ASSERT_GL(glUniform1i(glGetUniformLocation(this->program_id, "u_sNormalHeight2"), 3))
+    // bind texture units to shader samplers, the particle programs may have been bound since
+    ASSERT_GL(glUseProgram(program->id))
+    ASSERT_GL(glUniform1i(program->Uniform(UNIFORM_S_DIFFUSE), 0))
+    ASSERT_GL(glUniform1i(program->Uniform(UNIFORM_S_NORMALHEIGHT), 1))
+    ASSERT_GL(glUniform1i(program->Uniform(UNIFORM_S_SPECULAR), 2))
+    ASSERT_GL(glUniform1i(program->Uniform(UNIFORM_S_NORMALHEIGHT2), 3))
 
     // upload projection matrix
-    glm::mat4 matProjection = glm::perspective(35.0f, this->aspect, 0.01f, 100.0f);
-    ASSERT_GL(GLint u_matProjection = glGetUniformLocation(this->program_id, "u_matProjection"))
-    ASSERT_GL(glUniformMatrix4fv(u_matProjection, 1, GL_FALSE, glm::value_ptr(matProjection)))
+    glm::mat4 matProjection = glm::perspective(GAME_FOV, this->aspect, GAME_Z_NEAR, GAME_Z_FAR);
+    ASSERT_GL(glUniformMatrix4fv(program->Uniform(UNIFORM_MAT_PROJECTION), 1, GL_FALSE, glm::value_ptr(matProjection)))
+    ClusterManager::SetProjection(GAME_FOV, this->aspect, GAME_Z_NEAR, GAME_Z_FAR, width, height);
 
     // exposure
-    LightingManager::SetExposure(program_id, 1);
+    LightingManager::SetExposure(program, 1);
 
     // bloom
 
@@ -363,11 +322,8 @@ bool Game::Init(void)
     ASSERT_GL(glBindBuffer(GL_ARRAY_BUFFER, 0))
 
     // bloom program
-    if(!this->InitShaders("postproc_bloom.vsh", "postproc_bloom.fsh", &program_bloom)) return false;
-    ASSERT_GL(bloom_loc_fbo_a_vCoord = glGetAttribLocation(program_bloom, "a_vCoord"))
-    ASSERT_GL(bloom_loc_fbo_u_sFBO = glGetUniformLocation(program_bloom, "u_sFBO"))
-    ASSERT_GL(bloom_loc_fbo_u_bEnabled = glGetUniformLocation(program_bloom, "u_bEnabled"))
-    ASSERT_GL(glProgramUniform1i(program_bloom, bloom_loc_fbo_u_bEnabled, b_bloom))
+    program_bloom->SetUniform1i(UNIFORM_B_ENABLED, b_bloom);
+    program_bloom->SetUniform1i(UNIFORM_S_FBO, 5);
 
     // motionblur
 
@@ -404,12 +360,8 @@ bool Game::Init(void)
     ASSERT_GL(glBindBuffer(GL_ARRAY_BUFFER, 0))
 
     // motionblur program
-    if(!this->InitShaders("postproc_motionblur.vsh", "postproc_motionblur.fsh", &program_motionblur)) return false;
-    ASSERT_GL(motionblur_loc_fbo_a_vCoord = glGetAttribLocation(program_motionblur, "a_vCoord"))
-    ASSERT_GL(motionblur_loc_fbo_u_sFBO = glGetUniformLocation(program_motionblur, "u_sFBO"))
-    ASSERT_GL(motionblur_loc_fbo_u_bEnabled = glGetUniformLocation(program_motionblur, "u_bEnabled"))
-    ASSERT_GL(motionblur_loc_fbo_u_vVelocity = glGetUniformLocation(program_motionblur, "u_vVelocity"))
-    ASSERT_GL(glProgramUniform1i(program_motionblur, motionblur_loc_fbo_u_bEnabled, b_motionblur))
+    program_motionblur->SetUniform1i(UNIFORM_B_ENABLED, b_motionblur);
+    program_motionblur->SetUniform1i(UNIFORM_S_FBO, 6);
 
     // shadow mapping
 
@@ -464,15 +416,15 @@ bool Game::HandleSDL(SDL_Event *e)
             {
                 case SDLK_1: // toggle HDR
                     b_hdr = !b_hdr;
-                    ASSERT_GL(glProgramUniform1i(program_id, loc_u_bHDR, b_hdr))
+                    program->SetUniform1i(UNIFORM_B_HDR, b_hdr);
                     break;
                 case SDLK_2: // toggle bloom
                     b_bloom = !b_bloom;
-                    ASSERT_GL(glProgramUniform1i(program_bloom, bloom_loc_fbo_u_bEnabled, b_bloom))
+                    program_bloom->SetUniform1i(UNIFORM_B_ENABLED, b_bloom);
                     break;
                 case SDLK_3: // toggle motion blur
                     b_motionblur = !b_motionblur;
-                    ASSERT_GL(glProgramUniform1i(program_motionblur, motionblur_loc_fbo_u_bEnabled, b_motionblur))
+                    program_motionblur->SetUniform1i(UNIFORM_B_ENABLED, b_motionblur);
                     break;
                 case SDLK_4: // toggle particles create
                     b_particles_create = !b_particles_create;
@@ -481,6 +433,16 @@ bool Game::HandleSDL(SDL_Event *e)
                 case SDLK_5: // toggle particles update
                     b_particles_update = !b_particles_update;
                     break;
+                case SDLK_6: // toggle GPU particle simulation
+                    if(!particles.SetGpu(!particles.b_gpu)) fprintf(stderr, "GPU particles unavailable\n");
+                    else fprintf(stderr, "particles: %s\n", particles.b_gpu ? "GPU" : "CPU");
+                    break;
+                case SDLK_p: // dump profiler zones
+                    Profiler::Export("profile.json");
+                    break;
+                case SDLK_g: // toggle GPU pass times on the console
+                    GpuProfiler::b_print = !GpuProfiler::b_print;
+                    break;
             }
 
             break;
@@ -526,9 +488,9 @@ bool Game::HandleSDL(SDL_Event *e)
                     ASSERT_GL(glViewport(0, 0, width, height))
 
                     // upload new projection matrix
-                    glm::mat4 matProjection = glm::perspective(35.0f, aspect, 0.01f, 100.0f);
-                    ASSERT_GL(GLint u_matProjection = glGetUniformLocation(program_id, "u_matProjection"))
-                    ASSERT_GL(glUniformMatrix4fv(u_matProjection, 1, GL_FALSE, glm::value_ptr(matProjection)))
+                    glm::mat4 matProjection = glm::perspective(GAME_FOV, aspect, GAME_Z_NEAR, GAME_Z_FAR);
+                    program->SetUniformMatrix4fv(UNIFORM_MAT_PROJECTION, 1, glm::value_ptr(matProjection));
+                    ClusterManager::SetProjection(GAME_FOV, aspect, GAME_Z_NEAR, GAME_Z_FAR, width, height);
 
                     break;
             }
@@ -542,14 +504,15 @@ bool Game::HandleSDL(SDL_Event *e)
 #define GAME_DOMAIN "Game::Update"
 bool Game::Update(float seconds)
 {
+    PROFILE_ZONE("Game::Update");
+
     static float f = 0;
     f += seconds;
 
     // moving light
     //LightingManager::lights[2].vPosition.x = -2 * cos(2 * f);
     //LightingManager::lights[2].vPosition.z = -2 * sin(2 * f);
-
-    LightingManager::UploadLights(program_id);
+    //LightingManager::UploadLight(2);
 
     // particles
     if(b_particles_update) particles.Update(seconds * 1000);
@@ -616,20 +579,24 @@ bool Game::Update(float seconds)
     //camera = glm::translate(matIdentity, velocity * seconds) * camera;
     velocity *= fmax(0, 1 - (3.5f * seconds));
 
-    ASSERT_GL(glProgramUniform3fv(program_motionblur, motionblur_loc_fbo_u_vVelocity, 1, glm::value_ptr(velocity)))
+    program_motionblur->SetUniform3fv(UNIFORM_V_VELOCITY, 1, glm::value_ptr(velocity));
 
     return true;
 }
 #undef GAME_DOMAIN
 
-#define GAME_DOMAIN "Game::Draw"
-bool Game::Draw(void)
+#define GAME_DOMAIN "Game::DrawScene"
+void Game::DrawScene(void)
 {
-    // SCENE
+    PROFILE_ZONE("Game::DrawScene");
+    GpuProfiler::Begin(GPU_PASS_SCENE);
 
     // bind bloom framebuffer and use normal program
     ASSERT_GL(glBindFramebuffer(GL_FRAMEBUFFER, bloom_fbo))
-    ASSERT_GL(glUseProgram(program_id))
+    ASSERT_GL(glUseProgram(program->id))
+
+    // upload lights and materials changed since the last frame
+    LightingManager::Flush();
 
     //ASSERT_GL(glClearColor(0.6f, 0.65f, 0.9f, 1.0f))
     ASSERT_GL(glClearColor(0.02, 0.05, 0.1, 1))
@@ -639,20 +606,28 @@ bool Game::Draw(void)
     glm::mat4 matRotation = glm::toMat4(orientation);
     glm::mat4 matCamera = matRotation * matTranslation;
 
-    ASSERT_GL(GLint u_matCamera = glGetUniformLocation(program_id, "u_matCamera"))
-    ASSERT_GL(GLint u_matModelView = glGetUniformLocation(program_id, "u_matModelView"))
+    ASSERT_GL(glUniformMatrix4fv(program->Uniform(UNIFORM_MAT_CAMERA), 1, GL_FALSE, glm::value_ptr(matCamera)))
 
-    ASSERT_GL(glUniformMatrix4fv(u_matCamera, 1, GL_FALSE, glm::value_ptr(matCamera)))
+    // bin lights into view space clusters for this camera
+    ClusterManager::Build(matCamera);
 
-    cube_left.Draw(program_id, u_matModelView, matCamera);
-    cube_right.Draw(program_id, u_matModelView, matCamera);
-    particles.Draw(program_id, u_matModelView, matCamera);
+    cube_left.Draw(program, matCamera);
+    cube_right.Draw(program, matCamera);
+    particles.Draw(program, matCamera);
 
-    // BLOOM
+    GpuProfiler::End(GPU_PASS_SCENE);
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "Game::DrawBloom"
+void Game::DrawBloom(void)
+{
+    PROFILE_ZONE("Game::DrawBloom");
+    GpuProfiler::Begin(GPU_PASS_BLOOM);
 
     // bind motionblur framebuffer and use bloom program
     ASSERT_GL(glBindFramebuffer(GL_FRAMEBUFFER, motionblur_fbo))
-    ASSERT_GL(glUseProgram(program_bloom))
+    ASSERT_GL(glUseProgram(program_bloom->id))
 
     ASSERT_GL(glClearColor(0, 0, 0, 1))
     ASSERT_GL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT))
@@ -660,19 +635,27 @@ bool Game::Draw(void)
     // draw framebuffer as texture
     ASSERT_GL(glActiveTexture(GL_TEXTURE5))
     ASSERT_GL(glBindTexture(GL_TEXTURE_2D, bloom_tex_fbo))
-    ASSERT_GL(glUniform1i(bloom_loc_fbo_u_sFBO, 5))
 
-    ASSERT_GL(glEnableVertexAttribArray(bloom_loc_fbo_a_vCoord))
+    GLint bloom_a_vCoord = program_bloom->Attrib(ATTRIB_COORD);
+    ASSERT_GL(glEnableVertexAttribArray(bloom_a_vCoord))
     ASSERT_GL(glBindBuffer(GL_ARRAY_BUFFER, bloom_vbo_fbo_vertices))
-    ASSERT_GL(glVertexAttribPointer(bloom_loc_fbo_a_vCoord, 2, GL_FLOAT, GL_FALSE, 0, 0))
+    ASSERT_GL(glVertexAttribPointer(bloom_a_vCoord, 2, GL_FLOAT, GL_FALSE, 0, 0))
     ASSERT_GL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4))
-    ASSERT_GL(glDisableVertexAttribArray(bloom_loc_fbo_a_vCoord))
+    ASSERT_GL(glDisableVertexAttribArray(bloom_a_vCoord))
 
-    // MOTIONBLUR
+    GpuProfiler::End(GPU_PASS_BLOOM);
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "Game::DrawMotionBlur"
+void Game::DrawMotionBlur(void)
+{
+    PROFILE_ZONE("Game::DrawMotionBlur");
+    GpuProfiler::Begin(GPU_PASS_MOTIONBLUR);
 
     // unbind framebuffer and use motionblur program
     ASSERT_GL(glBindFramebuffer(GL_FRAMEBUFFER, 0))
-    ASSERT_GL(glUseProgram(program_motionblur))
+    ASSERT_GL(glUseProgram(program_motionblur->id))
 
     ASSERT_GL(glClearColor(0, 0, 0, 1))
     ASSERT_GL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT))
@@ -680,29 +663,53 @@ bool Game::Draw(void)
     // draw framebuffer as texture
     ASSERT_GL(glActiveTexture(GL_TEXTURE6))
     ASSERT_GL(glBindTexture(GL_TEXTURE_2D, motionblur_tex_fbo))
-    ASSERT_GL(glUniform1i(motionblur_loc_fbo_u_sFBO, 6))
 
-    ASSERT_GL(glEnableVertexAttribArray(motionblur_loc_fbo_a_vCoord))
+    GLint motionblur_a_vCoord = program_motionblur->Attrib(ATTRIB_COORD);
+    ASSERT_GL(glEnableVertexAttribArray(motionblur_a_vCoord))
     ASSERT_GL(glBindBuffer(GL_ARRAY_BUFFER, motionblur_vbo_fbo_vertices))
-    ASSERT_GL(glVertexAttribPointer(motionblur_loc_fbo_a_vCoord, 2, GL_FLOAT, GL_FALSE, 0, 0))
+    ASSERT_GL(glVertexAttribPointer(motionblur_a_vCoord, 2, GL_FLOAT, GL_FALSE, 0, 0))
     ASSERT_GL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4))
-    ASSERT_GL(glDisableVertexAttribArray(motionblur_loc_fbo_a_vCoord))
+    ASSERT_GL(glDisableVertexAttribArray(motionblur_a_vCoord))
+
+    GpuProfiler::End(GPU_PASS_MOTIONBLUR);
+}
+#undef GAME_DOMAIN
 
-    SDL_GL_SwapWindow(wnd);
+bool Game::Draw(void)
+{
+    PROFILE_ZONE("Game::Draw");
+
+    // swap in whatever textures finished loading
+    AssetLoader::Update();
+
+    // read back pass timings from a few frames ago
+    GpuProfiler::BeginFrame();
+
+    // scene into the bloom framebuffer
+    DrawScene();
+
+    // bloom into the motionblur framebuffer
+    DrawBloom();
+
+    // motionblur onto the screen
+    DrawMotionBlur();
 
     return true;
 }
-#undef GAME_DOMAIN
 
 bool Game::Destroy(void)
 {
+    AssetLoader::Destroy();
     if(!this->DestroySDL()) return false;
+    ResourceManager::Unmount();
     return true;
 }
 
 int Game::Run(int argc, const char **argv)
 {
+    if(!bench.ParseArgs(argc, argv)) return 1;
     if(!this->Init()) return 1;
+    if(bench.enabled) return this->RunBenchmark();
 
     Uint32 current_time = SDL_GetTicks();
     Uint32 previous_time;
@@ -719,6 +726,9 @@ int Game::Run(int argc, const char **argv)
         if(accumulator >= timestep)
         {
             if(!this->Draw()) this->running = false;
+
+            PROFILE_ZONE("SDL_GL_SwapWindow");
+            SDL_GL_SwapWindow(wnd);
         }
 
         for(;accumulator >= timestep; accumulator -= timestep)
@@ -744,3 +754,44 @@ int Game::Run(int argc, const char **argv)
 
     return 0;
 }
+
+/* fixed timestep, scripted camera and no input, so two runs with the same
+ * seed draw the same frames
+ */
+int Game::RunBenchmark(void)
+{
+    // frames are compared against a golden image, so no fallbacks may be drawn
+    AssetLoader::Finish();
+    bench.Init();
+
+    SDL_Event e;
+    bool result = true;
+
+    for(unsigned int frame=0; frame<bench.frames; ++frame)
+    {
+        bench.BeginFrame();
+
+        if(!this->Update(bench.timestep)) break;
+        bench.Camera(frame, &position, &orientation);
+        if(!this->Draw()) break;
+
+        bench.EndFrame();
+
+        if(frame + 1 == bench.frames) result = bench.Capture(width, height);
+
+        {
+            PROFILE_ZONE("SDL_GL_SwapWindow");
+            SDL_GL_SwapWindow(wnd);
+        }
+
+        // keep the window system happy, input is ignored
+        while(SDL_PollEvent(&e));
+    }
+
+    result = bench.Finish() && result;
+    if(bench.trace_path != NULL) Profiler::Export(bench.trace_path);
+
+    if(!this->Destroy()) return 1;
+
+    return result ? 0 : 2;
+}
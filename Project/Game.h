@@ -26,14 +26,31 @@
 
 #include "ResourceManager.h"
 #include "TextureManager.h"
+#include "AssetLoader.h"
+#include "ShaderProgram.h"
+#include "ProgramCache.h"
+#include "ShaderBuilder.h"
 #include "LightingManager.h"
+#include "ClusterManager.h"
 #include "CubeDrawable.h"
 #include "ParticlesDrawable.h"
+#include "GpuProfiler.h"
+#include "Benchmark.h"
 
 #define GAME_ATTRIB_VERTEX 0
 #define GAME_ATTRIB_NORMAL 1
 #define GAME_ATTRIB_TEXCOORD 2
 
+#define GAME_FOV 35.0f
+#define GAME_Z_NEAR 0.01f
+#define GAME_Z_FAR 100.0f
+
+// packed assets built by `make pack`, loose files are used without it
+#define GAME_ASSET_ARCHIVE "assets.pak"
+
+// linked program binaries, safe to delete at any time
+#define GAME_PROGRAM_CACHE "shadercache"
+
 class Game
 {
 protected:
@@ -46,12 +63,12 @@ protected:
     float height;
     float aspect;
 
-    GLuint program_id;
-    GLuint loc_u_bHDR;
+    ShaderProgram *program;
 
     GLuint tex;
     GLuint nmap;
     GLuint glossmap;
+    GLuint nmap2;
 
     GLuint bloom_fbo;
     GLuint bloom_tex_fbo;
@@ -63,16 +80,9 @@ protected:
     GLuint motionblur_rbo_depth;
     GLuint motionblur_vbo_fbo_vertices;
 
-    GLuint program_bloom;
-    GLuint bloom_loc_fbo_a_vCoord;
-    GLuint bloom_loc_fbo_u_sFBO;
-    GLuint bloom_loc_fbo_u_bEnabled;
-
-    GLuint program_motionblur;
-    GLuint motionblur_loc_fbo_a_vCoord;
-    GLuint motionblur_loc_fbo_u_sFBO;
-    GLuint motionblur_loc_fbo_u_bEnabled;
-    GLuint motionblur_loc_fbo_u_vVelocity;
+    ShaderProgram *program_bloom;
+    ShaderProgram *program_motionblur;
+    ShaderProgram *program_particles;
 
     GLuint fbo_shadow;
 
@@ -93,16 +103,20 @@ protected:
     bool b_motionblur;
     bool b_particles_create;
     bool b_particles_update;
+
+    // the three render passes making up Draw
+    void DrawScene(void);
+    void DrawBloom(void);
+    void DrawMotionBlur(void);
 public:
     Game() : particles(NUM_LIGHTS - 5) {}
     static Game * New(void) { return new Game(); }
-    void PrintShaderError(GLint shader);
 
     bool running;
+    Benchmark bench;
     
     bool InitSDL(void);
     bool InitGLEW(void);
-    bool InitShaders(const char *v_path, const char *f_path, GLuint *program);
     bool DestroySDL(void);
 
     bool Init(void);
@@ -111,6 +125,7 @@ public:
     bool Update(float seconds);
     bool Destroy(void);
     int Run(int argc = 0, const char **argv = NULL);
+    int RunBenchmark(void);
 };
 
 #endif
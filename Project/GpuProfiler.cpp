@@ -0,0 +1,253 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "GpuProfiler.h"
+
+bool GpuProfiler::b_timer;
+bool GpuProfiler::b_stats;
+
+GLuint GpuProfiler::time_queries[GPU_PROFILER_FRAMES][NUM_GPU_PASSES];
+GLuint GpuProfiler::stat_queries[GPU_PROFILER_FRAMES][NUM_GPU_PASSES][NUM_GPU_STATS];
+
+Uint64 GpuProfiler::submitted[GPU_PROFILER_FRAMES][NUM_GPU_PASSES];
+bool GpuProfiler::b_pending[GPU_PROFILER_FRAMES];
+unsigned int GpuProfiler::slot_frames[GPU_PROFILER_FRAMES];
+
+unsigned int GpuProfiler::frame;
+unsigned int GpuProfiler::dropped;
+
+double GpuProfiler::sums[NUM_GPU_PASSES];
+unsigned int GpuProfiler::num_summed;
+
+GpuFrameCallback GpuProfiler::callback;
+void *GpuProfiler::callback_user;
+
+GpuPassResult GpuProfiler::results[NUM_GPU_PASSES];
+bool GpuProfiler::b_print = false;
+bool GpuProfiler::b_wait = false;
+
+const char *GpuProfiler::pass_names[NUM_GPU_PASSES] =
+{
+    "scene",
+    "bloom",
+    "motionblur",
+};
+
+const char *GpuProfiler::stat_names[NUM_GPU_STATS] =
+{
+    "vertices",
+    "primitives",
+    "vs_invocations",
+    "fs_invocations",
+    "clipping_in",
+    "clipping_out",
+};
+
+const GLenum GpuProfiler::stat_targets[NUM_GPU_STATS] =
+{
+    GL_VERTICES_SUBMITTED_ARB,
+    GL_PRIMITIVES_SUBMITTED_ARB,
+    GL_VERTEX_SHADER_INVOCATIONS_ARB,
+    GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+    GL_CLIPPING_INPUT_PRIMITIVES_ARB,
+    GL_CLIPPING_OUTPUT_PRIMITIVES_ARB,
+};
+
+// zone names for the CPU profiler trace
+static const char *trace_names[NUM_GPU_PASSES] =
+{
+    "GPU scene",
+    "GPU bloom",
+    "GPU motionblur",
+};
+
+#define GAME_DOMAIN "GpuProfiler::Init"
+void GpuProfiler::Init(void)
+{
+#if defined(_WIN32) || defined(__linux__)
+    b_timer = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+#else
+    b_timer = true;
+#endif
+
+    // GLEW does not know this extension yet, so look for it by name
+    b_stats = GLDebug::HasExtension("GL_ARB_pipeline_statistics_query");
+
+    if(b_timer)
+    {
+        ASSERT_GL(glGenQueries(GPU_PROFILER_FRAMES * NUM_GPU_PASSES, &time_queries[0][0]))
+    }
+    else fprintf(stderr, "GpuProfiler::Init: timer queries unavailable\n");
+
+    if(b_stats)
+    {
+        ASSERT_GL(glGenQueries(GPU_PROFILER_FRAMES * NUM_GPU_PASSES * NUM_GPU_STATS, &stat_queries[0][0][0]))
+    }
+
+    Profiler::NameTrack(GPU_PROFILER_TRACK, "GPU");
+}
+#undef GAME_DOMAIN
+
+void GpuProfiler::SetCallback(GpuFrameCallback callback, void *user)
+{
+    GpuProfiler::callback = callback;
+    GpuProfiler::callback_user = user;
+}
+
+#define GAME_DOMAIN "GpuProfiler::Collect"
+bool GpuProfiler::Collect(unsigned int slot, bool wait)
+{
+    if(!b_pending[slot]) return true;
+
+    /* the last query of the slot finishes last, but only within one target, so the last
+     * statistics query is checked as well
+     */
+    if(!wait)
+    {
+        GLint available;
+        ASSERT_GL(glGetQueryObjectiv(time_queries[slot][NUM_GPU_PASSES - 1], GL_QUERY_RESULT_AVAILABLE, &available))
+        if(!available) return false;
+
+        if(b_stats)
+        {
+            ASSERT_GL(glGetQueryObjectiv(stat_queries[slot][NUM_GPU_PASSES - 1][NUM_GPU_STATS - 1],
+                                         GL_QUERY_RESULT_AVAILABLE, &available))
+            if(!available) return false;
+        }
+    }
+
+    b_pending[slot] = false;
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    for(unsigned int p=0; p<NUM_GPU_PASSES; ++p)
+    {
+        GLuint64 ns;
+        ASSERT_GL(glGetQueryObjectui64v(time_queries[slot][p], GL_QUERY_RESULT, &ns))
+        results[p].ms = ns / 1000000.0;
+
+        for(unsigned int s=0; s<NUM_GPU_STATS; ++s)
+        {
+            results[p].stats[s] = 0;
+            if(b_stats)
+            {
+                ASSERT_GL(glGetQueryObjectui64v(stat_queries[slot][p][s], GL_QUERY_RESULT, &results[p].stats[s]))
+            }
+        }
+
+        /* only durations are measured, so each GPU zone is drawn starting at
+         * the point its pass was submitted
+         */
+        Uint64 start = submitted[slot][p];
+        Profiler::Record(trace_names[p], "gpu", start, start + (Uint64)(ns * frequency / 1000000000.0),
+                         GPU_PROFILER_TRACK);
+
+        sums[p] += results[p].ms;
+    }
+
+    if(callback) callback(callback_user, slot_frames[slot], results);
+
+    if(++num_summed >= GPU_PROFILER_PRINT_INTERVAL)
+    {
+        if(b_print)
+        {
+            fprintf(stderr, "GPU ms:");
+            for(unsigned int p=0; p<NUM_GPU_PASSES; ++p)
+            {
+                fprintf(stderr, " %s %.3f", pass_names[p], sums[p] / num_summed);
+            }
+            if(dropped > 0) fprintf(stderr, " (%u frames dropped)", dropped);
+            fprintf(stderr, "\n");
+        }
+
+        memset(sums, 0, sizeof(sums));
+        num_summed = 0;
+        dropped = 0;
+    }
+
+    return true;
+}
+#undef GAME_DOMAIN
+
+void GpuProfiler::BeginFrame(void)
+{
+    ++frame;
+    if(!b_timer) return;
+
+    // results still missing after GPU_PROFILER_FRAMES frames are dropped
+    unsigned int slot = frame % GPU_PROFILER_FRAMES;
+    if(!Collect(slot, b_wait))
+    {
+        b_pending[slot] = false;
+        ++dropped;
+    }
+}
+
+#define GAME_DOMAIN "GpuProfiler::Begin"
+void GpuProfiler::Begin(GpuPass pass)
+{
+    if(!b_timer) return;
+
+    unsigned int slot = frame % GPU_PROFILER_FRAMES;
+    submitted[slot][pass] = Profiler::Now();
+
+    ASSERT_GL(glBeginQuery(GL_TIME_ELAPSED, time_queries[slot][pass]))
+    if(b_stats)
+    {
+        for(unsigned int s=0; s<NUM_GPU_STATS; ++s)
+        {
+            ASSERT_GL(glBeginQuery(stat_targets[s], stat_queries[slot][pass][s]))
+        }
+    }
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "GpuProfiler::End"
+void GpuProfiler::End(GpuPass pass)
+{
+    if(!b_timer) return;
+
+    ASSERT_GL(glEndQuery(GL_TIME_ELAPSED))
+    if(b_stats)
+    {
+        for(unsigned int s=0; s<NUM_GPU_STATS; ++s)
+        {
+            ASSERT_GL(glEndQuery(stat_targets[s]))
+        }
+    }
+
+    // the frame is complete once its last pass has been queued
+    if(pass == NUM_GPU_PASSES - 1)
+    {
+        b_pending[frame % GPU_PROFILER_FRAMES] = true;
+        slot_frames[frame % GPU_PROFILER_FRAMES] = frame;
+    }
+}
+#undef GAME_DOMAIN
+
+void GpuProfiler::Flush(void)
+{
+    if(!b_timer) return;
+
+    // oldest first so callbacks arrive in order
+    for(unsigned int i=1; i<=GPU_PROFILER_FRAMES; ++i)
+    {
+        Collect((frame + i) % GPU_PROFILER_FRAMES, true);
+    }
+}
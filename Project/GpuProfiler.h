@@ -0,0 +1,125 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#include "common.h"
+
+// ARB_pipeline_statistics_query, missing from older GLEW headers
+#ifndef GL_VERTICES_SUBMITTED_ARB
+#define GL_VERTICES_SUBMITTED_ARB 0x82EE
+#define GL_PRIMITIVES_SUBMITTED_ARB 0x82EF
+#define GL_VERTEX_SHADER_INVOCATIONS_ARB 0x82F0
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#define GL_CLIPPING_INPUT_PRIMITIVES_ARB 0x82F6
+#define GL_CLIPPING_OUTPUT_PRIMITIVES_ARB 0x82F7
+#endif
+
+// frames of queries in flight, results are read this many frames late
+#define GPU_PROFILER_FRAMES 3
+
+// frames averaged for each console report
+#define GPU_PROFILER_PRINT_INTERVAL 120
+
+// profiler track the GPU zones are drawn on
+#define GPU_PROFILER_TRACK 1
+
+enum GpuPass
+{
+    GPU_PASS_SCENE,
+    GPU_PASS_BLOOM,
+    GPU_PASS_MOTIONBLUR,
+    NUM_GPU_PASSES
+};
+
+enum GpuStat
+{
+    GPU_STAT_VERTICES,
+    GPU_STAT_PRIMITIVES,
+    GPU_STAT_VS_INVOCATIONS,
+    GPU_STAT_FS_INVOCATIONS,
+    GPU_STAT_CLIPPING_IN,
+    GPU_STAT_CLIPPING_OUT,
+    NUM_GPU_STATS
+};
+
+struct GpuPassResult
+{
+    double ms;
+    GLuint64 stats[NUM_GPU_STATS];
+};
+
+// called with every frame whose results have been read back
+typedef void (*GpuFrameCallback)(void *user, unsigned int frame, const GpuPassResult *results);
+
+class GpuProfiler
+{
+protected:
+    static bool b_timer;
+    static bool b_stats;
+
+    static GLuint time_queries[GPU_PROFILER_FRAMES][NUM_GPU_PASSES];
+    static GLuint stat_queries[GPU_PROFILER_FRAMES][NUM_GPU_PASSES][NUM_GPU_STATS];
+
+    // CPU time each pass was submitted, used to place it in the trace
+    static Uint64 submitted[GPU_PROFILER_FRAMES][NUM_GPU_PASSES];
+    static bool b_pending[GPU_PROFILER_FRAMES];
+    static unsigned int slot_frames[GPU_PROFILER_FRAMES];
+
+    static unsigned int frame;
+    static unsigned int dropped;
+
+    static double sums[NUM_GPU_PASSES];
+    static unsigned int num_summed;
+
+    static GpuFrameCallback callback;
+    static void *callback_user;
+
+    static bool Collect(unsigned int slot, bool wait);
+public:
+    static const char *pass_names[NUM_GPU_PASSES];
+    static const char *stat_names[NUM_GPU_STATS];
+    static const GLenum stat_targets[NUM_GPU_STATS];
+
+    // latest frame that was read back
+    static GpuPassResult results[NUM_GPU_PASSES];
+
+    // print averaged pass times to the console
+    static bool b_print;
+
+    // block on results instead of dropping frames whose queries are late
+    static bool b_wait;
+
+    static void Init(void);
+
+    static inline bool HasTimer(void) { return b_timer; }
+    static inline bool HasStats(void) { return b_stats; }
+    static inline unsigned int Frame(void) { return frame; }
+
+    static void SetCallback(GpuFrameCallback callback, void *user);
+
+    // start a new frame, reading back whatever the reused slot holds
+    static void BeginFrame(void);
+
+    static void Begin(GpuPass pass);
+    static void End(GpuPass pass);
+
+    // wait for every frame still in flight
+    static void Flush(void);
+};
+
+#endif
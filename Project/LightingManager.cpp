@@ -20,63 +20,71 @@ LightType LightingManager::light_types[NUM_LIGHT_TYPES];
 Light LightingManager::lights[NUM_LIGHTS];
 Material LightingManager::materials[NUM_MATERIALS];
 
-#define GAME_DOMAIN "LightingManager::UploadLightTypes"
-void LightingManager::UploadLightTypes(GLuint program_id)
+GLuint LightingManager::ubo_light_types;
+GLuint LightingManager::ubo_lights;
+GLuint LightingManager::ubo_materials;
+
+DirtyRange LightingManager::light_types_dirty;
+DirtyRange LightingManager::lights_dirty;
+DirtyRange LightingManager::materials_dirty;
+
+#define GAME_DOMAIN "LightingManager::InitBuffers"
+static GLuint MakeUniformBuffer(ShaderProgram *program, ShaderBlock block, GLuint binding, GLsizeiptr size)
 {
-    GLuint binding = 1;
-    ASSERT_GL(GLuint block_index = glGetUniformBlockIndex(program_id, "LightTypesBlock"))
-    ASSERT_GL(glUniformBlockBinding(program_id, block_index, binding))
+    ASSERT_GL(glUniformBlockBinding(program->id, program->Block(block), binding))
 
     GLuint buffer;
     ASSERT_GL(glGenBuffers(1, &buffer))
     ASSERT_GL(glBindBuffer(GL_UNIFORM_BUFFER, buffer))
-    ASSERT_GL(glBufferData(GL_UNIFORM_BUFFER, sizeof(light_types), light_types, GL_DYNAMIC_DRAW))
+    ASSERT_GL(glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW))
     ASSERT_GL(glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer))
+
+    return buffer;
+}
+
+void LightingManager::InitBuffers(ShaderProgram *program)
+{
+    ubo_light_types = MakeUniformBuffer(program, BLOCK_LIGHT_TYPES, 1, sizeof(light_types));
+    ubo_lights      = MakeUniformBuffer(program, BLOCK_LIGHTS,      2, sizeof(lights));
+    ubo_materials   = MakeUniformBuffer(program, BLOCK_MATERIALS,   3, sizeof(materials));
 }
 #undef GAME_DOMAIN
 
-#define GAME_DOMAIN "LightingManager::UploadLights"
-void LightingManager::UploadLights(GLuint program_id)
+#define GAME_DOMAIN "LightingManager::Flush"
+template <typename T>
+static void FlushRange(GLuint buffer, DirtyRange *range, const T *data)
 {
-    GLuint binding = 2;
-    ASSERT_GL(GLuint block_index = glGetUniformBlockIndex(program_id, "LightsBlock"))
-    ASSERT_GL(glUniformBlockBinding(program_id, block_index, binding))
+    if(!range->dirty) return;
+
+    GLintptr offset = range->first * sizeof(T);
+    GLsizeiptr size = (range->last - range->first + 1) * sizeof(T);
 
-    GLuint buffer;
-    ASSERT_GL(glGenBuffers(1, &buffer))
     ASSERT_GL(glBindBuffer(GL_UNIFORM_BUFFER, buffer))
-    ASSERT_GL(glBufferData(GL_UNIFORM_BUFFER, sizeof(lights), lights, GL_DYNAMIC_DRAW))
-    ASSERT_GL(glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer))
+    ASSERT_GL(glBufferSubData(GL_UNIFORM_BUFFER, offset, size, &data[range->first]))
+
+    range->Clear();
 }
-#undef GAME_DOMAIN
 
-#define GAME_DOMAIN "LightingManager::UploadMaterials"
-void LightingManager::UploadMaterials(GLuint program_id)
+void LightingManager::Flush(void)
 {
-    GLuint binding = 3;
-    ASSERT_GL(GLuint block_index = glGetUniformBlockIndex(program_id, "MaterialsBlock"))
-    ASSERT_GL(glUniformBlockBinding(program_id, block_index, binding))
+    PROFILE_ZONE("LightingManager::Flush");
 
-    GLuint buffer;
-    ASSERT_GL(glGenBuffers(1, &buffer))
-    ASSERT_GL(glBindBuffer(GL_UNIFORM_BUFFER, buffer))
-    ASSERT_GL(glBufferData(GL_UNIFORM_BUFFER, sizeof(materials), materials, GL_DYNAMIC_DRAW))
-    ASSERT_GL(glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer))
+    FlushRange(ubo_light_types, &light_types_dirty, light_types);
+    FlushRange(ubo_lights, &lights_dirty, lights);
+    FlushRange(ubo_materials, &materials_dirty, materials);
 }
 #undef GAME_DOMAIN
 
 #define GAME_DOMAIN "LightingManager::SetMaterial"
-void LightingManager::SetMaterial(GLuint program_id, GLint material_id)
+void LightingManager::SetMaterial(ShaderProgram *program, GLint material_id)
 {
-    ASSERT_GL(GLint loc = glGetUniformLocation(program_id, "u_nMaterial"));
-    ASSERT_GL(glUniform1i(loc, material_id));
+    ASSERT_GL(glUniform1i(program->Uniform(UNIFORM_N_MATERIAL), material_id));
 }
 #undef GAME_DOMAIN
 
 #define GAME_DOMAIN "LightingManager::SetExposure"
-void LightingManager::SetExposure(GLuint program_id, GLfloat exposure)
+void LightingManager::SetExposure(ShaderProgram *program, GLfloat exposure)
 {
-    ASSERT_GL(GLint loc = glGetUniformLocation(program_id, "u_fExposure"))
-    ASSERT_GL(glUniform1f(loc, exposure))
+    ASSERT_GL(glUniform1f(program->Uniform(UNIFORM_F_EXPOSURE), exposure))
 }
 #undef GAME_DOMAIN
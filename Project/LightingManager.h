@@ -18,6 +18,7 @@
 #define LIGHTINGMANAGER_H
 
 #include "common.h"
+#include "ShaderProgram.h"
 
 #define NUM_LIGHT_TYPES 16
 #define NUM_LIGHTS 128
@@ -54,6 +55,39 @@ struct Material
     GLint nReserved2;
 };
 
+// inclusive range of array indices modified since the last flush
+struct DirtyRange
+{
+    unsigned int first;
+    unsigned int last;
+    bool dirty;
+
+    inline void Mark(unsigned int index)
+    {
+        if(!dirty)
+        {
+            first = last = index;
+            dirty = true;
+        }
+        else
+        {
+            if(index < first) first = index;
+            if(index > last) last = index;
+        }
+    }
+
+    inline void Mark(unsigned int from, unsigned int to)
+    {
+        Mark(from);
+        Mark(to);
+    }
+
+    inline void Clear(void)
+    {
+        dirty = false;
+    }
+};
+
 class LightingManager
 {
 public:
@@ -61,10 +95,21 @@ public:
     static Light lights[NUM_LIGHTS];
     static Material materials[NUM_MATERIALS];
 
-    // TODO: make use of glBufferSubData for these functions
-    //static void UploadLightType(GLuint program_id, unsigned int index);
-    //static void UploadLight(GLuint program_id, unsigned int index);
-    //static void UploadMaterial(GLuint program_id, unsigned int index);
+    // persistent uniform buffers, one per block
+    static GLuint ubo_light_types;
+    static GLuint ubo_lights;
+    static GLuint ubo_materials;
+
+    static DirtyRange light_types_dirty;
+    static DirtyRange lights_dirty;
+    static DirtyRange materials_dirty;
+
+    /* call these after writing to light_types, lights or materials directly
+     * the changed entries are uploaded by the next call to Flush
+     */
+    static inline void UploadLightType(unsigned int index) { light_types_dirty.Mark(index); }
+    static inline void UploadLight(unsigned int index) { lights_dirty.Mark(index); }
+    static inline void UploadMaterial(unsigned int index) { materials_dirty.Mark(index); }
 
     static inline void MakeLightType(unsigned int index,
                                      glm::vec4 vAmbient, glm::vec4 vDiffuse, glm::vec4 vSpecular,
@@ -76,6 +121,7 @@ public:
         light_types[index].fAttenuationConst = fAConst;
         light_types[index].fAttenuationLinear = fALinear;
         light_types[index].fAttenuationQuadratic = fAQuad;
+        UploadLightType(index);
     }
 
     static inline void MakeLight(unsigned int index, GLboolean bActive, GLuint nType, glm::vec4 vPos)
@@ -83,6 +129,7 @@ public:
         lights[index].vPosition = vPos;
         lights[index].nType = nType;
         lights[index].bActive = bActive;
+        UploadLight(index);
     }
 
     static inline void MakeMaterial(unsigned int index,
@@ -94,10 +141,15 @@ public:
         materials[index].vSpecular = vSpecular;
         materials[index].fShininess = fShininess;
         materials[index].fGlow = fGlow;
+        UploadMaterial(index);
     }
 
-    static inline void Init(GLuint program_id)
+    static void InitBuffers(ShaderProgram *program);
+
+    static inline void Init(ShaderProgram *program)
     {
+        InitBuffers(program);
+
         for(unsigned int i=0; i<NUM_LIGHT_TYPES; ++i)
         {
             MakeLightType(i, glm::vec4(0,0,0,1), glm::vec4(1,1,1,1), glm::vec4(1,1,1,1), 1, 0, 0.1f);
@@ -113,23 +165,27 @@ public:
             MakeMaterial(i, glm::vec4(0,0,0,1), glm::vec4(1,1,1,1), glm::vec4(1,1,1,1), 64, 0);
         }
 
-        SetMaterial(program_id, 0);
-        SetExposure(program_id, 1.0f);
+        SetMaterial(program, 0);
+        SetExposure(program, 1.0f);
     }
 
-    static void UploadLightTypes(GLuint program_id);
-    static void UploadLights(GLuint program_id);
-    static void UploadMaterials(GLuint program_id);
+    static inline void UploadLightTypes(void) { light_types_dirty.Mark(0, NUM_LIGHT_TYPES - 1); }
+    static inline void UploadLights(void) { lights_dirty.Mark(0, NUM_LIGHTS - 1); }
+    static inline void UploadMaterials(void) { materials_dirty.Mark(0, NUM_MATERIALS - 1); }
 
-    static inline void UploadAll(GLuint program_id)
+    static inline void UploadAll(void)
     {
-        UploadLightTypes(program_id);
-        UploadLights(program_id);
-        UploadMaterials(program_id);
+        UploadLightTypes();
+        UploadLights();
+        UploadMaterials();
+        Flush();
     }
 
-    static void SetMaterial(GLuint program_id, GLint material_id);
-    static void SetExposure(GLuint program_id, GLfloat exposure);
+    // upload every dirty range with glBufferSubData, once per frame
+    static void Flush(void);
+
+    static void SetMaterial(ShaderProgram *program, GLint material_id);
+    static void SetExposure(ShaderProgram *program, GLfloat exposure);
 };
 
 #endif
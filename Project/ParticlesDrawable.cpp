@@ -16,21 +16,396 @@
 
 #include "ParticlesDrawable.h"
 
-template <>
-void BoundedValue<GLfloat>::Clamp(void)
+// widest instruction set the compiler was allowed to use, build with -mavx2 for 8 lanes
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PARTICLE_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARTICLE_SIMD_WIDTH 4
+#else
+#define PARTICLE_SIMD_WIDTH 1
+#endif
+
+/* one channel of count particles: snap into jerk, jerk into acceleration and
+ * acceleration into velocity, each step clamped, then velocity into value
+ * every array is padded to a multiple of 8 so whole vectors can be loaded
+ * values are also written to out, unless it is NULL
+ */
+static void IntegrateChannel(float **d, const float *lo, const float *hi, float ms, unsigned int count,
+                             float *out, unsigned int stride)
+{
+    float *x = d[PARTICLE_VALUE];
+    float *v = d[PARTICLE_VELOCITY];
+    float *a = d[PARTICLE_ACCELERATION];
+    float *j = d[PARTICLE_JERK];
+    const float *s = d[PARTICLE_SNAP];
+
+    unsigned int i = 0;
+
+#if PARTICLE_SIMD_WIDTH == 8
+    __m256 t = _mm256_set1_ps(ms);
+    __m256 v_lo = _mm256_set1_ps(lo[PARTICLE_VELOCITY]), v_hi = _mm256_set1_ps(hi[PARTICLE_VELOCITY]);
+    __m256 a_lo = _mm256_set1_ps(lo[PARTICLE_ACCELERATION]), a_hi = _mm256_set1_ps(hi[PARTICLE_ACCELERATION]);
+    __m256 j_lo = _mm256_set1_ps(lo[PARTICLE_JERK]), j_hi = _mm256_set1_ps(hi[PARTICLE_JERK]);
+
+    for(; i<count; i+=8)
+    {
+        __m256 jj = _mm256_add_ps(_mm256_loadu_ps(j + i), _mm256_mul_ps(_mm256_loadu_ps(s + i), t));
+        jj = _mm256_min_ps(_mm256_max_ps(jj, j_lo), j_hi);
+        __m256 aa = _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_mul_ps(jj, t));
+        aa = _mm256_min_ps(_mm256_max_ps(aa, a_lo), a_hi);
+        __m256 vv = _mm256_add_ps(_mm256_loadu_ps(v + i), _mm256_mul_ps(aa, t));
+        vv = _mm256_min_ps(_mm256_max_ps(vv, v_lo), v_hi);
+        __m256 xx = _mm256_add_ps(_mm256_loadu_ps(x + i), vv);
+
+        _mm256_storeu_ps(j + i, jj);
+        _mm256_storeu_ps(a + i, aa);
+        _mm256_storeu_ps(v + i, vv);
+        _mm256_storeu_ps(x + i, xx);
+
+        unsigned int n = count - i < 8 ? count - i : 8;
+        if(out) for(unsigned int k=0; k<n; ++k) out[(i + k) * stride] = x[i + k];
+    }
+#elif PARTICLE_SIMD_WIDTH == 4
+    __m128 t = _mm_set1_ps(ms);
+    __m128 v_lo = _mm_set1_ps(lo[PARTICLE_VELOCITY]), v_hi = _mm_set1_ps(hi[PARTICLE_VELOCITY]);
+    __m128 a_lo = _mm_set1_ps(lo[PARTICLE_ACCELERATION]), a_hi = _mm_set1_ps(hi[PARTICLE_ACCELERATION]);
+    __m128 j_lo = _mm_set1_ps(lo[PARTICLE_JERK]), j_hi = _mm_set1_ps(hi[PARTICLE_JERK]);
+
+    for(; i<count; i+=4)
+    {
+        __m128 jj = _mm_add_ps(_mm_loadu_ps(j + i), _mm_mul_ps(_mm_loadu_ps(s + i), t));
+        jj = _mm_min_ps(_mm_max_ps(jj, j_lo), j_hi);
+        __m128 aa = _mm_add_ps(_mm_loadu_ps(a + i), _mm_mul_ps(jj, t));
+        aa = _mm_min_ps(_mm_max_ps(aa, a_lo), a_hi);
+        __m128 vv = _mm_add_ps(_mm_loadu_ps(v + i), _mm_mul_ps(aa, t));
+        vv = _mm_min_ps(_mm_max_ps(vv, v_lo), v_hi);
+        __m128 xx = _mm_add_ps(_mm_loadu_ps(x + i), vv);
+
+        _mm_storeu_ps(j + i, jj);
+        _mm_storeu_ps(a + i, aa);
+        _mm_storeu_ps(v + i, vv);
+        _mm_storeu_ps(x + i, xx);
+
+        unsigned int n = count - i < 4 ? count - i : 4;
+        if(out) for(unsigned int k=0; k<n; ++k) out[(i + k) * stride] = x[i + k];
+    }
+#else
+    for(; i<count; ++i)
+    {
+        j[i] = fmin(fmax(j[i] + s[i] * ms, lo[PARTICLE_JERK]), hi[PARTICLE_JERK]);
+        a[i] = fmin(fmax(a[i] + j[i] * ms, lo[PARTICLE_ACCELERATION]), hi[PARTICLE_ACCELERATION]);
+        v[i] = fmin(fmax(v[i] + a[i] * ms, lo[PARTICLE_VELOCITY]), hi[PARTICLE_VELOCITY]);
+        x[i] += v[i];
+
+        if(out) out[i * stride] = x[i];
+    }
+#endif
+}
+
+void ParticlesDrawable::Integrate(float ms, unsigned int count)
+{
+    // where each channel lands in the vertex buffer, x and z rotation are not drawn
+    ParticleVertex *pv = particle_vertices;
+    float *outs[NUM_PARTICLE_CHANNELS] =
+    {
+        &pv->position.x, &pv->position.y, &pv->position.z,
+        NULL, &pv->rotation, NULL,
+        &pv->offset.x, &pv->offset.y, &pv->offset.z,
+        &pv->point_size,
+    };
+
+    for(unsigned int c=0; c<NUM_PARTICLE_CHANNELS; ++c)
+    {
+        float *d[NUM_PARTICLE_DERIVATIVES];
+        float lo[NUM_PARTICLE_DERIVATIVES], hi[NUM_PARTICLE_DERIVATIVES];
+        for(unsigned int k=0; k<NUM_PARTICLE_DERIVATIVES; ++k)
+        {
+            d[k] = state[k][c];
+            lo[k] = bounds.min[k][c];
+            hi[k] = bounds.max[k][c];
+        }
+
+        IntegrateChannel(d, lo, hi, ms, count, outs[c], sizeof(ParticleVertex) / sizeof(float));
+    }
+}
+
+const char *ParticlesDrawable::feedback_varyings[] =
+{
+    "v_vValue0",
+    "v_vValue1",
+    "v_vVelocity0",
+    "v_vVelocity1",
+    "v_vAcceleration0",
+    "v_vAcceleration1",
+    "v_vJerk0",
+    "v_vJerk1",
+    "v_vSnap0",
+    "v_vSnap1",
+    "v_fTimeRemaining",
+};
+
+const GLsizei ParticlesDrawable::num_feedback_varyings = sizeof(feedback_varyings) / sizeof(feedback_varyings[0]);
+
+const char *ParticlesDrawable::sim_attribs[] =
+{
+    "a_vValue0",
+    "a_vValue1",
+    "a_vVelocity0",
+    "a_vVelocity1",
+    "a_vAcceleration0",
+    "a_vAcceleration1",
+    "a_vJerk0",
+    "a_vJerk1",
+    "a_vSnap0",
+    "a_vSnap1",
+    "a_fTimeRemaining",
+};
+
+const GLsizei ParticlesDrawable::num_sim_attribs = sizeof(sim_attribs) / sizeof(sim_attribs[0]);
+
+// float of the vertex layout each channel is stored in, x and z rotation are not kept
+static const int gpu_lanes[NUM_PARTICLE_CHANNELS] =
+{
+    0, 1, 2,
+    -1, 7, -1,
+    4, 5, 6,
+    3,
+};
+
+void ParticlesDrawable::Pack(const float *channels, float *out)
+{
+    for(unsigned int c=0; c<NUM_PARTICLE_CHANNELS; ++c)
+    {
+        if(gpu_lanes[c] >= 0) out[gpu_lanes[c]] = channels[c];
+    }
+}
+
+#define GAME_DOMAIN "ParticlesDrawable::EnableVertexAttribs"
+void ParticlesDrawable::EnableVertexAttribs(ShaderProgram *program, GLsizei stride)
+{
+    EnableAttrib(program, ATTRIB_VERTEX,    3, GL_FLOAT, stride, offsetof(ParticleVertex, position));
+    EnableAttrib(program, ATTRIB_POINTSIZE, 1, GL_FLOAT, stride, offsetof(ParticleVertex, point_size));
+    EnableAttrib(program, ATTRIB_OFFSET,    3, GL_FLOAT, stride, offsetof(ParticleVertex, offset));
+    EnableAttrib(program, ATTRIB_ROTATION,  1, GL_FLOAT, stride, offsetof(ParticleVertex, rotation));
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ParticlesDrawable::InitGpu"
+bool ParticlesDrawable::InitGpu(ShaderProgram *program, ShaderProgram *sim_program)
+{
+    if(sim_program == NULL) return false;
+    this->sim_program = sim_program;
+
+    gpu_spawns = new ParticleGpuState[num];
+    gpu_births = new long long[num];
+
+    GLsizeiptr size = num * sizeof(ParticleGpuState);
+    GLsizei stride = sizeof(ParticleGpuState);
+
+    ASSERT_GL(glGenVertexArrays(2, gpu_sim_vaos))
+    ASSERT_GL(glGenVertexArrays(2, gpu_draw_vaos))
+
+    for(unsigned int b=0; b<2; ++b)
+    {
+        ASSERT_GL(glBindVertexArray(gpu_sim_vaos[b]))
+        gpu_buffers[b] = MakeBuffer(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+
+        // sim_attribs binds two vec4s per derivative to locations 0-9, then the time left
+        for(GLuint i=0; i<NUM_PARTICLE_DERIVATIVES * 2; ++i)
+        {
+            ASSERT_GL(glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, stride, (const GLvoid *)(i * sizeof(glm::vec4))))
+            ASSERT_GL(glEnableVertexAttribArray(i))
+        }
+        GLuint loc = NUM_PARTICLE_DERIVATIVES * 2;
+        ASSERT_GL(glVertexAttribPointer(loc, 1, GL_FLOAT, GL_FALSE, stride,
+                                        (const GLvoid *)offsetof(ParticleGpuState, time_remaining)))
+        ASSERT_GL(glEnableVertexAttribArray(loc))
+
+        ASSERT_GL(glBindVertexArray(gpu_draw_vaos[b]))
+        ASSERT_GL(glBindBuffer(GL_ARRAY_BUFFER, gpu_buffers[b]))
+        EnableVertexAttribs(program, stride);
+    }
+
+    gpu_readback = MakeBuffer(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_READ);
+
+    // bounds of velocity, acceleration and jerk in the same layout as the state
+    glm::vec4 lo[(NUM_PARTICLE_DERIVATIVES - 2) * 2];
+    glm::vec4 hi[(NUM_PARTICLE_DERIVATIVES - 2) * 2];
+    for(unsigned int d=PARTICLE_VELOCITY; d<PARTICLE_SNAP; ++d)
+    {
+        Pack(bounds.min[d], &lo[(d - PARTICLE_VELOCITY) * 2].x);
+        Pack(bounds.max[d], &hi[(d - PARTICLE_VELOCITY) * 2].x);
+    }
+
+    GLsizei count = sizeof(lo) / sizeof(lo[0]);
+    sim_program->SetUniform4fv(UNIFORM_V_BOUNDSMIN, count, &lo[0].x);
+    sim_program->SetUniform4fv(UNIFORM_V_BOUNDSMAX, count, &hi[0].x);
+
+    return true;
+}
+#undef GAME_DOMAIN
+
+bool ParticlesDrawable::SetGpu(bool b_gpu)
+{
+    if(b_gpu && sim_program == NULL) return false;
+
+    // hand every light back, positions are not carried between backends
+    if(this->b_gpu)
+    {
+        for(unsigned int i=0; i<live; ++i) ReleaseLight(particle_lights[(gpu_tail + i) % num]);
+    }
+    else
+    {
+        for(unsigned int i=0; i<live; ++i) ReleaseLight(particle_lights[i]);
+    }
+
+    live = 0;
+    gpu_src = 0;
+    gpu_head = gpu_tail = 0;
+    num_gpu_spawns = 0;
+    gpu_clock = 0;
+    gpu_frames = 0;
+    b_gpu_readback = false;
+
+    this->b_gpu = b_gpu;
+    return true;
+}
+
+void ParticlesDrawable::CreateParticleGpu(void)
+{
+    unsigned int slot = gpu_head;
+    gpu_head = (gpu_head + 1) % num;
+    ++live;
+
+    float init[NUM_PARTICLE_DERIVATIVES][NUM_PARTICLE_CHANNELS];
+    Emit(init);
+
+    ParticleGpuState *p = &gpu_spawns[num_gpu_spawns++];
+    memset(p, 0, sizeof(ParticleGpuState));
+    Pack(init[PARTICLE_VALUE], &p->vertex.position.x);
+    for(unsigned int d=PARTICLE_VELOCITY; d<NUM_PARTICLE_DERIVATIVES; ++d) Pack(init[d], &p->derivatives[d - 1][0].x);
+    p->time_remaining = PARTICLE_LIFETIME;
+
+    gpu_births[slot] = gpu_clock;
+    particle_lights[slot] = AcquireLight();
+    if(particle_lights[slot] >= 0) PlaceLight(particle_lights[slot], &p->vertex);
+}
+
+#define GAME_DOMAIN "ParticlesDrawable::SimulateGpu"
+void ParticlesDrawable::SimulateGpu(unsigned int first, unsigned int count)
 {
-    if(value < min) value = min;
-    if(value > max) value = max;
+    GLsizeiptr stride = sizeof(ParticleGpuState);
+
+    // results land in the same slots of the other buffer
+    ASSERT_GL(glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, gpu_buffers[1 - gpu_src], first * stride, count * stride))
+    ASSERT_GL(glBeginTransformFeedback(GL_POINTS))
+    ASSERT_GL(glDrawArrays(GL_POINTS, first, count))
+    ASSERT_GL(glEndTransformFeedback())
 }
+#undef GAME_DOMAIN
 
-template <>
-void BoundedValue<glm::vec3>::Clamp(void)
+#define GAME_DOMAIN "ParticlesDrawable::UpdateGpu"
+void ParticlesDrawable::UpdateGpu(long long ms)
 {
-    if(value.x < min.x) value.x = min.x;
-    if(value.y < min.y) value.y = min.y;
-    if(value.z < min.z) value.z = min.z;
+    GLsizeiptr stride = sizeof(ParticleGpuState);
+
+    // new particles go into the buffer about to be read, wrapping at most once
+    if(num_gpu_spawns > 0)
+    {
+        unsigned int first = (gpu_head + num - num_gpu_spawns) % num;
+        unsigned int n = num_gpu_spawns < num - first ? num_gpu_spawns : num - first;
+
+        UpdateBuffer(gpu_buffers[gpu_src], GL_ARRAY_BUFFER, first * stride, n * stride, gpu_spawns);
+        if(n < num_gpu_spawns)
+        {
+            UpdateBuffer(gpu_buffers[gpu_src], GL_ARRAY_BUFFER, 0, (num_gpu_spawns - n) * stride, gpu_spawns + n);
+        }
+        num_gpu_spawns = 0;
+    }
+
+    // particles die in the order they spawned, they all live equally long
+    gpu_clock += ms;
+    while(live > 0 && gpu_births[gpu_tail] + PARTICLE_LIFETIME <= gpu_clock)
+    {
+        ReleaseLight(particle_lights[gpu_tail]);
+        gpu_tail = (gpu_tail + 1) % num;
+        --live;
+    }
+
+    if(live == 0) return;
+
+    ASSERT_GL(glUseProgram(sim_program->id))
+    ASSERT_GL(glUniform1f(sim_program->Uniform(UNIFORM_F_TIMESTEP), (float)ms))
+    ASSERT_GL(glBindVertexArray(gpu_sim_vaos[gpu_src]))
+    ASSERT_GL(glEnable(GL_RASTERIZER_DISCARD))
+
+    unsigned int n = live < num - gpu_tail ? live : num - gpu_tail;
+    SimulateGpu(gpu_tail, n);
+    if(n < live) SimulateGpu(0, live - n);
+
+    ASSERT_GL(glDisable(GL_RASTERIZER_DISCARD))
+    gpu_src = 1 - gpu_src;
+
+    if(++gpu_frames >= PARTICLE_READBACK_INTERVAL)
+    {
+        gpu_frames = 0;
+        ReadbackGpu();
+    }
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ParticlesDrawable::ReadbackGpu"
+void ParticlesDrawable::ReadbackGpu(void)
+{
+    PROFILE_ZONE("ParticlesDrawable::ReadbackGpu");
+
+    GLsizeiptr size = num * sizeof(ParticleGpuState);
+
+    /* the copy was queued PARTICLE_READBACK_INTERVAL frames ago and should be
+     * done, particles spawned since then are left where they were emitted
+     */
+    if(b_gpu_readback)
+    {
+        ASSERT_GL(glBindBuffer(GL_COPY_WRITE_BUFFER, gpu_readback))
+        ASSERT_GL(const ParticleGpuState *states =
+                  (const ParticleGpuState *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, GL_MAP_READ_BIT))
+        if(states)
+        {
+            for(unsigned int i=0; i<live; ++i)
+            {
+                unsigned int slot = (gpu_tail + i) % num;
+                if(particle_lights[slot] >= 0 && gpu_births[slot] < gpu_readback_clock)
+                {
+                    PlaceLight(particle_lights[slot], &states[slot].vertex);
+                }
+            }
+            ASSERT_GL(glUnmapBuffer(GL_COPY_WRITE_BUFFER))
+        }
+    }
+
+    ASSERT_GL(glBindBuffer(GL_COPY_READ_BUFFER, gpu_buffers[gpu_src]))
+    ASSERT_GL(glBindBuffer(GL_COPY_WRITE_BUFFER, gpu_readback))
+    ASSERT_GL(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size))
+
+    gpu_readback_clock = gpu_clock;
+    b_gpu_readback = true;
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ParticlesDrawable::DrawGpu"
+void ParticlesDrawable::DrawGpu(void)
+{
+    if(live == 0) return;
+
+    ASSERT_GL(glBindVertexArray(gpu_draw_vaos[gpu_src]))
 
-    if(value.x > max.x) value.x = max.x;
-    if(value.y > max.y) value.y = max.y;
-    if(value.z > max.z) value.z = max.z;
+    unsigned int n = live < num - gpu_tail ? live : num - gpu_tail;
+    ASSERT_GL(glDrawArrays(GL_POINTS, gpu_tail, n))
+    if(n < live)
+    {
+        ASSERT_GL(glDrawArrays(GL_POINTS, 0, live - n))
+    }
 }
+#undef GAME_DOMAIN
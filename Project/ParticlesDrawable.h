@@ -17,199 +17,337 @@
 #ifndef PARTICLESDRAWABLE_H
 #define PARTICLESDRAWABLE_H
 
+#include <stddef.h>
+
 #include "Drawable.h"
 
-template <typename T>
-struct BoundedValue
+// scalar channels integrated independently by the particle kernel
+enum ParticleChannel
 {
-    T value;
-    T min;
-    T max;
-
-    void Clamp(void);
+    PARTICLE_POSITION_X,
+    PARTICLE_POSITION_Y,
+    PARTICLE_POSITION_Z,
+    PARTICLE_ROTATION_X,
+    PARTICLE_ROTATION_Y,
+    PARTICLE_ROTATION_Z,
+    PARTICLE_OFFSET_X,
+    PARTICLE_OFFSET_Y,
+    PARTICLE_OFFSET_Z,
+    PARTICLE_SIZE,
+    NUM_PARTICLE_CHANNELS
 };
 
-template <typename T>
-struct ParticleAttribute
+// the value of a channel and its derivatives, each stored as its own array
+enum ParticleDerivative
 {
-    BoundedValue<T> velocity;
-    BoundedValue<T> acceleration;
-    BoundedValue<T> jerk;
-    BoundedValue<T> snap;
-
-    void Update(long long ms)
-    {
-        jerk.value += snap.value * (float)ms;
-        jerk.Clamp();
+    PARTICLE_VALUE,
+    PARTICLE_VELOCITY,
+    PARTICLE_ACCELERATION,
+    PARTICLE_JERK,
+    PARTICLE_SNAP,
+    NUM_PARTICLE_DERIVATIVES
+};
 
-        acceleration.value += jerk.value * (float)ms;
-        acceleration.Clamp();
+/* velocity, acceleration and jerk are clamped to these after every step,
+ * they are the same for every particle of the emitter
+ */
+struct ParticleBounds
+{
+    float min[NUM_PARTICLE_DERIVATIVES][NUM_PARTICLE_CHANNELS];
+    float max[NUM_PARTICLE_DERIVATIVES][NUM_PARTICLE_CHANNELS];
+};
 
-        velocity.value += acceleration.value * (float)ms;
-        velocity.Clamp();
-    }
+// interleaved so a frame of particles is a single upload
+struct ParticleVertex
+{
+    glm::vec3 position;
+    GLfloat point_size;
+    glm::vec3 offset;
+    GLfloat rotation;
 };
 
-struct Particle
+/* one particle of the GPU backend, captured by transform feedback
+ * the value of each channel is laid out as a ParticleVertex so the buffer can
+ * be drawn directly, every derivative after it uses the same two vec4 layout
+ */
+struct ParticleGpuState
 {
-    long long time_remaining;
+    ParticleVertex vertex;
+    glm::vec4 derivatives[NUM_PARTICLE_DERIVATIVES - 1][2];
+    GLfloat time_remaining;
+};
 
-    ParticleAttribute<glm::vec3> position;
-    ParticleAttribute<glm::vec3> rotation;
-    ParticleAttribute<glm::vec3> offset;
-    ParticleAttribute<GLfloat> size;
+// milliseconds each particle lives for
+#define PARTICLE_LIFETIME 5000
 
-    void Update(long long ms)
-    {
-        position.Update(ms);
-        rotation.Update(ms);
-        offset.Update(ms);
-        size.Update(ms);
-    }
-};
+// frames between reading GPU particle positions back for the lights
+#define PARTICLE_READBACK_INTERVAL 8
 
 class ParticlesDrawable : public Drawable
 {
 private:
     unsigned int num;
     long long timestep;
+    long long accumulator;
 
-    GLuint vbo_alive;
-    GLuint vbo_point_size;
-    GLuint vbo_rotation;
-    GLuint vbo_offset;
+    GLuint vbo_particles;
+    ParticleVertex *particle_vertices;
 
-    GLint *alives;
-    GLfloat *point_sizes;
-    glm::vec3 *rotations;
-    glm::vec3 *offsets;
+    // structure of arrays particle state, padded to a multiple of the SIMD width
+    float *state[NUM_PARTICLE_DERIVATIVES][NUM_PARTICLE_CHANNELS];
+    float *time_remaining;
 
-    Particle *particles;
-protected:
-    virtual unsigned int Make(glm::vec3 **vertices, glm::vec3 **normals, glm::vec3 **tangents, glm::vec3 **bitangents,
-                              glm::vec2 **texcoords)
+    /* CPU: particles [0, live) are alive, a dying particle is replaced by the last one
+     * GPU: live particles fill a ring starting at gpu_tail, each keeps its slot
+     */
+    unsigned int live;
+
+    // light owned by each particle, or -1, it moves along with the particle
+    int *particle_lights;
+
+    // lights not owned by any particle
+    int free_lights[NUM_LIGHTS];
+    unsigned int num_free_lights;
+
+    ParticleBounds bounds;
+
+    // private generator so a seed reproduces the same particles
+    unsigned int rng;
+
+    // GPU backend, the simulation reads gpu_buffers[gpu_src] and writes the other one
+    ShaderProgram *sim_program;
+    GLuint gpu_buffers[2];
+    GLuint gpu_sim_vaos[2];
+    GLuint gpu_draw_vaos[2];
+    unsigned int gpu_src;
+
+    unsigned int gpu_head;
+    unsigned int gpu_tail;
+
+    // spawned this frame, uploaded to the ring in one go
+    ParticleGpuState *gpu_spawns;
+    unsigned int num_gpu_spawns;
+
+    // deaths are found on the CPU from spawn times, without reading the GPU
+    long long gpu_clock;
+    long long *gpu_births;
+
+    // positions are copied here and mapped a few frames later
+    GLuint gpu_readback;
+    long long gpu_readback_clock;
+    bool b_gpu_readback;
+    unsigned int gpu_frames;
+
+    inline float Random(void)
     {
-        *vertices   = new glm::vec3[num];
-        *normals    = new glm::vec3[num];
-        *tangents   = new glm::vec3[num];
-        *bitangents = new glm::vec3[num];
-        *texcoords  = new glm::vec2[num];
-
-        memset(*vertices,   0, num * sizeof(glm::vec3));
-        memset(*normals,    0, num * sizeof(glm::vec3));
-        memset(*tangents,   0, num * sizeof(glm::vec3));
-        memset(*bitangents, 0, num * sizeof(glm::vec3));
-        memset(*texcoords,  0, num * sizeof(glm::vec2));
-
-        for(unsigned int i=0; i<num; ++i)
-        {
-            (*vertices)[i].x = rand() / (float)RAND_MAX * 2 - 1;
-            (*vertices)[i].y = rand() / (float)RAND_MAX * 2 - 1;
-            (*vertices)[i].z = rand() / (float)RAND_MAX * 2 - 1;
-        }
+        rng = rng * 1664525u + 1013904223u;
+        return (rng >> 8) / (float)0xFFFFFF;
+    }
 
-        return num;
+    // initial state of a new particle, every channel not set here is zero
+    void Emit(float init[NUM_PARTICLE_DERIVATIVES][NUM_PARTICLE_CHANNELS])
+    {
+        memset(init, 0, NUM_PARTICLE_DERIVATIVES * NUM_PARTICLE_CHANNELS * sizeof(float));
+
+        init[PARTICLE_VALUE][PARTICLE_POSITION_Y] = -1;
+        init[PARTICLE_VALUE][PARTICLE_ROTATION_Y] = 3.14159265 * 2 * Random();
+        init[PARTICLE_VALUE][PARTICLE_OFFSET_X] = 0.1f * Random();
+        init[PARTICLE_VALUE][PARTICLE_SIZE] = 10;
+
+        init[PARTICLE_VELOCITY][PARTICLE_POSITION_Y] = 0.01f + 0.005f * Random();
+        init[PARTICLE_ACCELERATION][PARTICLE_POSITION_Y] = -0.000005f;
+        init[PARTICLE_VELOCITY][PARTICLE_SIZE] = 0.5f * Random();
+        init[PARTICLE_VELOCITY][PARTICLE_ROTATION_Y] = 0.001f + 0.005f * Random();
+        init[PARTICLE_ACCELERATION][PARTICLE_ROTATION_Y] = 0.000001f + 0.00001f * Random();
+        init[PARTICLE_VELOCITY][PARTICLE_OFFSET_X] = 0.00001f + 0.01f * Random();
     }
-public:
-    bool b_create;
 
-    ParticlesDrawable(unsigned int num) : Drawable(GL_DYNAMIC_DRAW), num(num), b_create(true) {}
+    inline int AcquireLight(void)
+    {
+        return num_free_lights > 0 ? free_lights[--num_free_lights] : -1;
+    }
 
-#define GAME_DOMAIN "ParticlesDrawable::Draw"
-    void Init(GLuint program_id)
+    inline void ReleaseLight(int light)
     {
-        Drawable::Init(program_id);
+        if(light < 0) return;
 
-        timestep = 10000.0f / num;
+        LightingManager::lights[light].bActive = 0;
+        LightingManager::UploadLight(light);
+        free_lights[num_free_lights++] = light;
+    }
+
+    void PlaceLight(int light, const ParticleVertex *pv)
+    {
+        float c = cos(pv->rotation);
+        float s = sin(pv->rotation);
+
+        // rotate about y, the same as the vertex shader
+        glm::vec3 v = pv->position + pv->offset;
+        LightingManager::lights[light].vPosition.x = c * v.x + s * v.z;
+        LightingManager::lights[light].vPosition.y = v.y;
+        LightingManager::lights[light].vPosition.z = c * v.z - s * v.x;
+        LightingManager::lights[light].bActive = 1;
+        LightingManager::UploadLight(light);
+    }
 
-        alives = new GLint[num];
-        point_sizes = new GLfloat[num];
-        rotations = new glm::vec3[num];
-        offsets = new glm::vec3[num];
+    // packs the channels of one derivative into the two vec4 vertex layout
+    static void Pack(const float *channels, float *out);
 
-        particles = new Particle[num];
+    // integrates every channel of particles [0, count) and writes the GPU arrays
+    void Integrate(float ms, unsigned int count);
 
-        memset(alives, 0, num * sizeof(GLint));
+    // copy particle src over dst, leaving src unused
+    void Move(unsigned int dst, unsigned int src)
+    {
+        for(unsigned int d=0; d<NUM_PARTICLE_DERIVATIVES; ++d)
+        {
+            for(unsigned int c=0; c<NUM_PARTICLE_CHANNELS; ++c) state[d][c][dst] = state[d][c][src];
+        }
+        time_remaining[dst] = time_remaining[src];
+        particle_lights[dst] = particle_lights[src];
 
-        vbo_alive = MakeVBO(num * sizeof(GLint), alives, program_id, "a_bAlive", 1, GL_INT, usage);
-        vbo_point_size = MakeVBO(num * sizeof(GLfloat), point_sizes, program_id, "a_fPointSize", 1, GL_FLOAT, usage);
-        vbo_rotation = MakeVBO(num * sizeof(glm::vec3), rotations, program_id, "a_vRotation", 3, GL_FLOAT, usage);
-        vbo_offset = MakeVBO(num * sizeof(glm::vec3), offsets, program_id, "a_vOffset", 3, GL_FLOAT, usage);
+        particle_vertices[dst] = particle_vertices[src];
     }
-#undef GAME_DOMAIN
 
-    void CreateParticle(unsigned int index)
+    void Kill(unsigned int index)
     {
-        if(!b_create) return;
+        ReleaseLight(particle_lights[index]);
+        if(index != --live) Move(index, live);
+    }
+
+    void CreateParticleGpu(void);
+    void UpdateGpu(long long ms);
+    void SimulateGpu(unsigned int first, unsigned int count);
+    void ReadbackGpu(void);
+    void DrawGpu(void);
+
+    static void EnableVertexAttribs(ShaderProgram *program, GLsizei stride);
+protected:
+    // points have no mesh, Init builds the particle buffer instead
+    virtual unsigned int Make(glm::vec3 **vertices, glm::vec3 **normals, glm::vec3 **tangents, glm::vec3 **bitangents,
+                              glm::vec2 **texcoords)
+    {
+        *vertices = *normals = *tangents = *bitangents = NULL;
+        *texcoords = NULL;
+        return 0;
+    }
+public:
+    // outputs of particles.vsh in ParticleGpuState order
+    static const char *feedback_varyings[];
+    static const GLsizei num_feedback_varyings;
+
+    // inputs of particles.vsh, bound to their index in ParticleGpuState order
+    static const char *sim_attribs[];
+    static const GLsizei num_sim_attribs;
+
+    bool b_create;
+    bool b_gpu;
 
-        //vertices[index].x = rand() / (float)RAND_MAX * 2 - 1;
-        //vertices[index].y = rand() / (float)RAND_MAX * 2 - 1;
-        //vertices[index].z = rand() / (float)RAND_MAX * 2 - 1;
+    ParticlesDrawable(unsigned int num) : Drawable(GL_DYNAMIC_DRAW), num(num), accumulator(0), live(0),
+                                          num_free_lights(0), rng(1), sim_program(NULL), b_create(true),
+                                          b_gpu(false) {}
 
-        vertices[index].x = 0;
-        vertices[index].y = -1;
-        vertices[index].z = 0;
+    // lights [first, last) are handed out to particles as they spawn
+    void SetLights(unsigned int first, unsigned int last)
+    {
+        num_free_lights = 0;
+        for(unsigned int i=last; i>first; --i) free_lights[num_free_lights++] = i - 1;
+    }
+
+    void Seed(unsigned int seed) { rng = seed; }
 
-        rotations[index].x = 0;
-        rotations[index].y = 3.14159265 * 2 * rand() / (float)RAND_MAX;
-        rotations[index].z = 0;
+#define GAME_DOMAIN "ParticlesDrawable::Init"
+    void Init(ShaderProgram *program)
+    {
+        Make(&vertices, &normals, &tangents, &bitangents, &texcoords);
+
+        timestep = 10000.0f / num;
 
-        offsets[index].x = 0.1f * rand() / (float)RAND_MAX;
-        offsets[index].y = 0;
-        offsets[index].z = 0;
+        particle_vertices = new ParticleVertex[num];
+        memset(particle_vertices, 0, num * sizeof(ParticleVertex));
 
-        alives[index] = 1;
-        point_sizes[index] = 10;
+        // round up so the kernel never needs a scalar tail
+        unsigned int padded = (num + 7) & ~7u;
+        for(unsigned int d=0; d<NUM_PARTICLE_DERIVATIVES; ++d)
+        {
+            for(unsigned int c=0; c<NUM_PARTICLE_CHANNELS; ++c)
+            {
+                state[d][c] = new float[padded];
+                memset(state[d][c], 0, padded * sizeof(float));
+            }
+        }
+        time_remaining = new float[padded];
+        memset(time_remaining, 0, padded * sizeof(float));
 
-        memset(&particles[index], 0, sizeof(Particle));
+        particle_lights = new int[num];
+        live = 0;
 
-        particles[index].time_remaining = 5000;
+        // anything not listed here is held at zero
+        memset(&bounds, 0, sizeof(bounds));
 
-        particles[index].position.velocity.value.y = 0.01f + 0.005f * rand() / (float)RAND_MAX;
-        particles[index].position.velocity.min.y = -0.001f;
-        particles[index].position.velocity.max.y = 1;
-        particles[index].position.acceleration.value.y = -0.000005f;
-        particles[index].position.acceleration.min.y = -1;
-        particles[index].position.acceleration.max.y =  1;
+        bounds.min[PARTICLE_VELOCITY][PARTICLE_POSITION_Y] = -0.001f;
+        bounds.max[PARTICLE_VELOCITY][PARTICLE_POSITION_Y] = 1;
+        bounds.min[PARTICLE_ACCELERATION][PARTICLE_POSITION_Y] = -1;
+        bounds.max[PARTICLE_ACCELERATION][PARTICLE_POSITION_Y] =  1;
 
-        particles[index].size.velocity.value = 0.5f * rand() / (float)RAND_MAX;
-        particles[index].size.velocity.min = -100;
-        particles[index].size.velocity.max =  100;
+        bounds.min[PARTICLE_VELOCITY][PARTICLE_SIZE] = -100;
+        bounds.max[PARTICLE_VELOCITY][PARTICLE_SIZE] =  100;
 
-        particles[index].rotation.velocity.value.y = 0.001f + 0.005f * rand() / (float)RAND_MAX;
-        particles[index].rotation.velocity.min.y = -100;
-        particles[index].rotation.velocity.max.y =  100;
-        particles[index].rotation.acceleration.value.y = 0.000001f + 0.00001f * rand() / (float)RAND_MAX;
-        particles[index].rotation.acceleration.min.y = -100;
-        particles[index].rotation.acceleration.max.y =  100;
+        bounds.min[PARTICLE_VELOCITY][PARTICLE_ROTATION_Y] = -100;
+        bounds.max[PARTICLE_VELOCITY][PARTICLE_ROTATION_Y] =  100;
+        bounds.min[PARTICLE_ACCELERATION][PARTICLE_ROTATION_Y] = -100;
+        bounds.max[PARTICLE_ACCELERATION][PARTICLE_ROTATION_Y] =  100;
 
-        particles[index].offset.velocity.value.x = 0.00001f + 0.01f * rand() / (float)RAND_MAX;
-        particles[index].offset.velocity.min.x = 0;
-        particles[index].offset.velocity.max.x = 1;
+        bounds.min[PARTICLE_VELOCITY][PARTICLE_OFFSET_X] = 0;
+        bounds.max[PARTICLE_VELOCITY][PARTICLE_OFFSET_X] = 1;
 
+        ASSERT_GL(glGenVertexArrays(1, &vao))
         Bind();
-        UpdateBuffer(vbo_vertex, GL_ARRAY_BUFFER, index * sizeof(glm::vec3), sizeof(glm::vec3), &vertices[index]);
-        UpdateBuffer(vbo_alive, GL_ARRAY_BUFFER, index * sizeof(GLint), sizeof(GLint), &alives[index]);
-        UpdateBuffer(vbo_point_size, GL_ARRAY_BUFFER, index * sizeof(GLfloat), sizeof(GLfloat), &point_sizes[index]);
-        UpdateBuffer(vbo_rotation, GL_ARRAY_BUFFER, index * sizeof(glm::vec3), sizeof(glm::vec3), &rotations[index]);
-        UpdateBuffer(vbo_offset, GL_ARRAY_BUFFER, index * sizeof(glm::vec3), sizeof(glm::vec3), &offsets[index]);
+
+        // storage is respecified every frame, so nothing is uploaded yet
+        vbo_particles = MakeBuffer(GL_ARRAY_BUFFER, num * sizeof(ParticleVertex), NULL, GL_STREAM_DRAW);
+        EnableVertexAttribs(program, sizeof(ParticleVertex));
     }
+#undef GAME_DOMAIN
+
+    /* sets up the transform feedback backend, sim_program must be particles.vsh
+     * linked with feedback_varyings, call after Init
+     */
+    bool InitGpu(ShaderProgram *program, ShaderProgram *sim_program);
+
+    // switches backend, every live particle is dropped
+    bool SetGpu(bool b_gpu);
 
     void CreateParticle(void)
     {
-        for(unsigned int i=0; i<num; ++i)
+        if(!b_create || live >= num) return;
+
+        if(b_gpu)
         {
-            if(!alives[i])
-            {
-                CreateParticle(i);
-                break;
-            }
+            CreateParticleGpu();
+            return;
+        }
+
+        unsigned int index = live++;
+
+        float init[NUM_PARTICLE_DERIVATIVES][NUM_PARTICLE_CHANNELS];
+        Emit(init);
+
+        for(unsigned int d=0; d<NUM_PARTICLE_DERIVATIVES; ++d)
+        {
+            for(unsigned int c=0; c<NUM_PARTICLE_CHANNELS; ++c) state[d][c][index] = init[d][c];
         }
+
+        time_remaining[index] = PARTICLE_LIFETIME;
+        particle_lights[index] = AcquireLight();
+
+        Pack(init[PARTICLE_VALUE], &particle_vertices[index].position.x);
     }
 
     void Update(long long ms)
     {
-        static long long accumulator = 0;
+        PROFILE_ZONE("ParticlesDrawable::Update");
+
         accumulator += ms;
 
         for(;accumulator>=timestep; accumulator-=timestep)
@@ -217,66 +355,47 @@ public:
             CreateParticle();
         }
 
-        glm::mat3 matRotationY;
-        matRotationY[0] = glm::vec3(0, 0, 0);
-        matRotationY[1] = glm::vec3(0, 1, 0);
-        matRotationY[2] = glm::vec3(0, 0, 0);
+        if(b_gpu)
+        {
+            UpdateGpu(ms);
+            return;
+        }
 
+        Integrate((float)ms, live);
 
-        for(unsigned int i=0; i<num; ++i)
+        for(unsigned int i=0; i<live;)
         {
-            if(!alives[i]) continue;
-
-            if((particles[i].time_remaining -= ms) <= 0)
+            // the particle moved into this slot is checked next
+            if((time_remaining[i] -= ms) <= 0)
             {
-                alives[i] = 0;
-                LightingManager::lights[i + 5].bActive = 0;
+                Kill(i);
                 continue;
             }
 
-            particles[i].Update(ms);
-
-            vertices[i] += particles[i].position.velocity.value;
-            point_sizes[i] += particles[i].size.velocity.value;
-            rotations[i] += particles[i].rotation.velocity.value;
-            offsets[i] += particles[i].offset.velocity.value;
-
-            if(i < NUM_LIGHTS - 5)
-            {
-                // crazy optimization
-                float c = cos(rotations[i].y);
-                float s = sin(rotations[i].y);
-                matRotationY[0].x =  c;
-                matRotationY[0].z = -s;
-                matRotationY[2].x =  s;
-                matRotationY[2].z =  c;
-
-                glm::vec3 vAbsolute = matRotationY * (vertices[i] + offsets[i]);
-                LightingManager::lights[i + 5].vPosition.x = vAbsolute.x;
-                LightingManager::lights[i + 5].vPosition.y = vAbsolute.y;
-                LightingManager::lights[i + 5].vPosition.z = vAbsolute.z;
-                LightingManager::lights[i + 5].bActive = 1;
-            }
+            if(particle_lights[i] >= 0) PlaceLight(particle_lights[i], &particle_vertices[i]);
+            ++i;
         }
 
-        Bind();
-        UpdateBuffer(vbo_vertex, GL_ARRAY_BUFFER, 0, num * sizeof(glm::vec3), vertices);
-        UpdateBuffer(vbo_alive, GL_ARRAY_BUFFER, 0, num * sizeof(GLint), alives);
-        UpdateBuffer(vbo_point_size, GL_ARRAY_BUFFER, 0, num * sizeof(GLfloat), point_sizes);
-        UpdateBuffer(vbo_rotation, GL_ARRAY_BUFFER, 0, num * sizeof(glm::vec3), rotations);
-        UpdateBuffer(vbo_offset, GL_ARRAY_BUFFER, 0, num * sizeof(glm::vec3), offsets);
+        if(live == 0) return;
+
+        StreamBuffer(vbo_particles, GL_ARRAY_BUFFER, num * sizeof(ParticleVertex), live * sizeof(ParticleVertex),
+                     particle_vertices);
     }
 
 #define GAME_DOMAIN "ParticlesDrawable::Draw"
-    virtual void Draw(GLuint program_id, GLint u_matModelView, glm::mat4 matModelView)
+    virtual void Draw(ShaderProgram *program, glm::mat4 matModelView)
     {
-        Drawable::Draw(program_id, u_matModelView, matModelView);
+        Drawable::Draw(program, matModelView);
 
-        ASSERT_GL(GLint loc = glGetUniformLocation(program_id, "u_bPoints"))
+        GLint loc = program->Uniform(UNIFORM_B_POINTS);
         ASSERT_GL(glUniform1i(loc, 1))
 
         glDepthMask(GL_FALSE);
-        ASSERT_GL(glDrawArrays(GL_POINTS, 0, num))
+        if(b_gpu) DrawGpu();
+        else
+        {
+            ASSERT_GL(glDrawArrays(GL_POINTS, 0, live))
+        }
         glDepthMask(GL_TRUE);
 
         ASSERT_GL(glUniform1i(loc, 0))
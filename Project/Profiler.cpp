@@ -0,0 +1,97 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "Profiler.h"
+
+ProfileEvent Profiler::events[PROFILER_CAPACITY];
+SDL_atomic_t Profiler::head;
+
+Uint64 Profiler::origin;
+double Profiler::ticks_to_us = 1;
+
+unsigned long Profiler::thread_ids[PROFILER_MAX_THREADS];
+const char *Profiler::thread_names[PROFILER_MAX_THREADS];
+SDL_atomic_t Profiler::num_threads;
+
+bool Profiler::enabled = true;
+
+void Profiler::Init(void)
+{
+    origin = Now();
+    ticks_to_us = 1000000.0 / SDL_GetPerformanceFrequency();
+    NameThread("main");
+}
+
+void Profiler::NameThread(const char *name)
+{
+    NameTrack(SDL_ThreadID(), name);
+}
+
+void Profiler::NameTrack(unsigned long thread, const char *name)
+{
+    int i = SDL_AtomicAdd(&num_threads, 1);
+    if(i >= PROFILER_MAX_THREADS) return;
+
+    thread_ids[i] = thread;
+    thread_names[i] = name;
+}
+
+bool Profiler::Export(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if(!f)
+    {
+        fprintf(stderr, "Profiler::Export: error: could not open `%s`\n", path);
+        return false;
+    }
+
+    // once the ring has wrapped, the oldest zone sits at the write position
+    unsigned int total = (unsigned int)SDL_AtomicGet(&head);
+    unsigned int count = total < PROFILER_CAPACITY ? total : PROFILER_CAPACITY;
+    unsigned int first = total - count;
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    int threads = SDL_AtomicGet(&num_threads);
+    if(threads > PROFILER_MAX_THREADS) threads = PROFILER_MAX_THREADS;
+    for(int i=0; i<threads; ++i)
+    {
+        fprintf(f, "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %lu, \"args\": {\"name\": \"%s\"}},\n",
+                thread_ids[i], thread_names[i]);
+    }
+
+    for(unsigned int i=0; i<count; ++i)
+    {
+        const ProfileEvent *e = &events[(first + i) & (PROFILER_CAPACITY - 1)];
+
+        // skip zones that started before Init
+        if(e->start < origin) continue;
+
+        fprintf(f, "{\"ph\": \"X\", \"name\": \"%s\", \"cat\": \"%s\", \"pid\": 1, \"tid\": %lu, "
+                   "\"ts\": %.3f, \"dur\": %.3f},\n",
+                e->name, e->category, e->thread,
+                (e->start - origin) * ticks_to_us, (e->end - e->start) * ticks_to_us);
+    }
+
+    // trailing entry so every real event can end with a comma
+    fprintf(f, "{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": 1, \"args\": {\"name\": \"Project\"}}\n]}\n");
+    fclose(f);
+
+    fprintf(stderr, "Profiler: wrote %u zones to `%s`\n", count, path);
+    return true;
+}
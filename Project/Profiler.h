@@ -0,0 +1,96 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <SDL.h>
+
+// number of zones kept, older ones are overwritten (must be a power of two)
+#define PROFILER_CAPACITY 65536
+#define PROFILER_MAX_THREADS 32
+
+// zone names must be string literals, only the pointer is stored
+#define PROFILE_ZONE(NAME) ProfileZone PROFILE_CONCAT(_profile_zone_, __LINE__)(NAME)
+#define PROFILE_CONCAT(A, B) PROFILE_CONCAT2(A, B)
+#define PROFILE_CONCAT2(A, B) A##B
+
+struct ProfileEvent
+{
+    const char *name;
+    const char *category;
+    Uint64 start;
+    Uint64 end;
+    unsigned long thread;
+};
+
+class Profiler
+{
+protected:
+    static ProfileEvent events[PROFILER_CAPACITY];
+    static SDL_atomic_t head;
+
+    static Uint64 origin;
+    static double ticks_to_us;
+
+    static unsigned long thread_ids[PROFILER_MAX_THREADS];
+    static const char *thread_names[PROFILER_MAX_THREADS];
+    static SDL_atomic_t num_threads;
+public:
+    static bool enabled;
+
+    static void Init(void);
+
+    // call once from each thread that records zones
+    static void NameThread(const char *name);
+    static void NameTrack(unsigned long thread, const char *name);
+
+    static inline Uint64 Now(void) { return SDL_GetPerformanceCounter(); }
+
+    // timestamps are performance counter ticks
+    static inline void Record(const char *name, const char *category, Uint64 start, Uint64 end,
+                              unsigned long thread)
+    {
+        unsigned int slot = (unsigned int)SDL_AtomicAdd(&head, 1) & (PROFILER_CAPACITY - 1);
+        ProfileEvent *e = &events[slot];
+        e->name = name;
+        e->category = category;
+        e->start = start;
+        e->end = end;
+        e->thread = thread;
+    }
+
+    static inline double ToMilliseconds(Uint64 ticks) { return ticks * ticks_to_us / 1000.0; }
+
+    // writes every buffered zone in chrome://tracing format
+    static bool Export(const char *path);
+};
+
+class ProfileZone
+{
+protected:
+    const char *name;
+    Uint64 start;
+public:
+    inline ProfileZone(const char *name) : name(name), start(Profiler::Now()) {}
+
+    inline ~ProfileZone()
+    {
+        if(Profiler::enabled) Profiler::Record(name, "cpu", start, Profiler::Now(), SDL_ThreadID());
+    }
+};
+
+#endif
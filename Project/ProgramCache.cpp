@@ -0,0 +1,227 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <vector>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "ProgramCache.h"
+
+bool ProgramCache::b_enabled = false;
+std::string ProgramCache::path;
+Uint64 ProgramCache::driver = 0;
+
+#define GAME_DOMAIN "ProgramCache::Init"
+bool ProgramCache::Init(const char *path)
+{
+    b_enabled = false;
+
+#if defined(_WIN32) || defined(__linux__)
+    bool b_supported = GLEW_ARB_get_program_binary || GLEW_VERSION_4_1;
+#else
+    bool b_supported = true;
+#endif
+    if(!b_supported)
+    {
+        fprintf(stderr, "ProgramCache::Init: driver has no program binaries\n");
+        return false;
+    }
+
+    GLint num_formats = 0;
+    ASSERT_GL(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats))
+    if(num_formats <= 0)
+    {
+        fprintf(stderr, "ProgramCache::Init: driver has no program binary formats\n");
+        return false;
+    }
+
+#if defined(_WIN32)
+    int result = _mkdir(path);
+#else
+    int result = mkdir(path, 0755);
+#endif
+    if(result < 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "ProgramCache::Init: error: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    // a driver update invalidates every binary it wrote before
+    static const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    driver = Hash(NULL, 0);
+    for(unsigned int i=0; i<sizeof(names) / sizeof(names[0]); ++i)
+    {
+        ASSERT_GL(const char *name = (const char *)glGetString(names[i]))
+        if(name) driver = Hash(name, strlen(name) + 1, driver);
+    }
+
+    ProgramCache::path = path;
+    b_enabled = true;
+    return true;
+}
+#undef GAME_DOMAIN
+
+Uint64 ProgramCache::Hash(const void *data, size_t len, Uint64 hash)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for(size_t i=0; i<len; ++i)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+Uint64 ProgramCache::Key(const char **sources, const GLint *lengths, int num_sources,
+                         const char **varyings, GLsizei num_varyings,
+                         const char **attribs, GLsizei num_attribs, const char *defines)
+{
+    Uint32 version = PROGRAM_CACHE_VERSION;
+    Uint64 key = Hash(&version, sizeof(version), driver);
+
+    // every part is followed by its length so moving bytes between parts changes the key
+    for(int i=0; i<num_sources; ++i)
+    {
+        Uint32 len = (Uint32)lengths[i];
+        key = Hash(sources[i], len, key);
+        key = Hash(&len, sizeof(len), key);
+    }
+
+    for(GLsizei i=0; i<num_varyings; ++i) key = Hash(varyings[i], strlen(varyings[i]) + 1, key);
+
+    // a marker keeps varyings from reading as attributes
+    Uint32 num = (Uint32)num_attribs;
+    key = Hash(&num, sizeof(num), key);
+    for(GLsizei i=0; i<num_attribs; ++i) key = Hash(attribs[i], strlen(attribs[i]) + 1, key);
+
+    if(defines) key = Hash(defines, strlen(defines) + 1, key);
+    return key;
+}
+
+std::string ProgramCache::GetFile(Uint64 key)
+{
+    char name[32];
+    sprintf(name, "/%016llx.bin", (unsigned long long)key);
+    return path + name;
+}
+
+#define GAME_DOMAIN "ProgramCache::Load"
+GLuint ProgramCache::Load(Uint64 key)
+{
+    if(!b_enabled) return 0;
+
+    PROFILE_ZONE("ProgramCache::Load");
+
+    // a miss is normal on the first run, so a missing file is not an error
+    std::string file = GetFile(key);
+    FILE *fh = fopen(file.c_str(), "rb");
+    if(!fh) return 0;
+
+    ProgramCacheHeader header;
+    std::vector<char> binary;
+    bool b_ok = fread(&header, sizeof(header), 1, fh) == 1 &&
+                header.magic == PROGRAM_CACHE_MAGIC && header.version == PROGRAM_CACHE_VERSION &&
+                header.key == key && header.length > 0;
+    if(b_ok)
+    {
+        binary.resize(header.length);
+        b_ok = fread(&binary[0], 1, binary.size(), fh) == binary.size();
+    }
+    fclose(fh);
+
+    GLuint program_id = 0;
+    GLint link_status = GL_FALSE;
+    if(b_ok)
+    {
+        ASSERT_GL(program_id = glCreateProgram())
+        ASSERT_GL(glProgramBinary(program_id, header.format, &binary[0], header.length))
+        ASSERT_GL(glGetProgramiv(program_id, GL_LINK_STATUS, &link_status))
+    }
+
+    if(!link_status)
+    {
+        // stale or truncated, the source build writes a fresh one
+        fprintf(stderr, "ProgramCache::Load: discarding `%s`\n", file.c_str());
+        if(program_id)
+        {
+            ASSERT_GL(glDeleteProgram(program_id))
+        }
+        remove(file.c_str());
+        return 0;
+    }
+
+    return program_id;
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ProgramCache::Prepare"
+void ProgramCache::Prepare(GLuint program)
+{
+    if(!b_enabled) return;
+    ASSERT_GL(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE))
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ProgramCache::Store"
+bool ProgramCache::Store(Uint64 key, GLuint program)
+{
+    if(!b_enabled) return false;
+
+    PROFILE_ZONE("ProgramCache::Store");
+
+    GLint length = 0;
+    ASSERT_GL(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length))
+    if(length <= 0) return false;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    ASSERT_GL(glGetProgramBinary(program, length, &length, &format, &binary[0]))
+
+    ProgramCacheHeader header;
+    header.magic = PROGRAM_CACHE_MAGIC;
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = (Uint32)length;
+
+    std::string file = GetFile(key);
+    FILE *fh = fopen(file.c_str(), "wb");
+    if(!fh)
+    {
+        fprintf(stderr, "ProgramCache::Store: error: could not open `%s`\n", file.c_str());
+        return false;
+    }
+
+    bool b_ok = fwrite(&header, sizeof(header), 1, fh) == 1 &&
+                fwrite(&binary[0], 1, length, fh) == (size_t)length;
+    if(fclose(fh) != 0) b_ok = false;
+
+    // a partial file would only be discarded on the next load
+    if(!b_ok)
+    {
+        fprintf(stderr, "ProgramCache::Store: error writing `%s`\n", file.c_str());
+        remove(file.c_str());
+    }
+    return b_ok;
+}
+#undef GAME_DOMAIN
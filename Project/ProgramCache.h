@@ -0,0 +1,77 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <string>
+
+#include "common.h"
+
+#define PROGRAM_CACHE_MAGIC 0x42504741 // "AGPB" little-endian
+#define PROGRAM_CACHE_VERSION 1
+
+// leads every cached program file, the driver's binary follows
+struct ProgramCacheHeader
+{
+    Uint32 magic;
+    Uint32 version;
+    Uint64 key;
+    Uint32 format;
+    Uint32 length;
+};
+
+/* linked programs saved with glGetProgramBinary, one file per key
+ * a binary only loads on the driver that wrote it, so the driver strings are part of the key
+ * and a binary the driver refuses anyway is deleted and rebuilt from source
+ */
+class ProgramCache
+{
+protected:
+    static bool b_enabled;
+    static std::string path;
+
+    // hash of the vendor, renderer and version strings
+    static Uint64 driver;
+
+    static std::string GetFile(Uint64 key);
+public:
+    // creates the cache directory at path, the cache stays off if the driver has no program binaries
+    static bool Init(const char *path);
+
+    static inline bool IsEnabled(void) { return b_enabled; }
+
+    // 64 bit FNV-1a of len bytes continuing from hash
+    static Uint64 Hash(const void *data, size_t len, Uint64 hash = 14695981039346656037ULL);
+
+    /* the key of a program from its stage sources, in stage order, and the transform feedback
+     * varyings, bound attributes and defines that also decide what gets linked
+     */
+    static Uint64 Key(const char **sources, const GLint *lengths, int num_sources,
+                      const char **varyings, GLsizei num_varyings,
+                      const char **attribs = NULL, GLsizei num_attribs = 0, const char *defines = NULL);
+
+    // a linked program from the cache, 0 if there is none or the driver rejects it
+    static GLuint Load(Uint64 key);
+
+    // call before glLinkProgram on a program that will be stored
+    static void Prepare(GLuint program);
+
+    // writes the binary of a linked program
+    static bool Store(Uint64 key, GLuint program);
+};
+
+#endif
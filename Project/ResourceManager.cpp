@@ -15,66 +15,241 @@
  */
 
 #include "ResourceManager.h"
+#include "AssetArchive.h"
+#include "Profiler.h"
 
-#include "stdio.h"
-#include "stdlib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-char * ResourceManager::Load(const char *path, long *len)
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+std::map<std::string, Resource *> ResourceManager::cache;
+SDL_SpinLock ResourceManager::lock = 0;
+AssetArchive * ResourceManager::archive = NULL;
+
+// an empty file cannot be mapped, every one of them points here
+static const char empty_data[1] = { 0 };
+
+#if defined(_WIN32)
+bool ResourceManager::Map(Resource *resource)
 {
-    char *buffer = NULL;
-    long err = 0;
+    HANDLE file = CreateFileA(resource->path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "CreateFile: error opening `%s`\n", resource->path.c_str());
+        return false;
+    }
 
-    // open binary file for reading
-    FILE *fh = fopen(path, "rb");
-    if(!fh)
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size))
     {
-        fprintf(stderr, "fopen: error opening `%s`\n", path);
-        return NULL;
+        fprintf(stderr, "GetFileSizeEx: error on `%s`\n", resource->path.c_str());
+        CloseHandle(file);
+        return false;
     }
 
-    // fseek to end
-    err = fseek(fh, 0L, SEEK_END);
-    if(err != 0)
+    resource->size = (long)size.QuadPart;
+    resource->data = empty_data;
+    resource->mapping = NULL;
+
+    if(resource->size > 0)
     {
-        fprintf(stderr, "fseek: error\n");
-        return NULL;
+        resource->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(resource->mapping) resource->data = (const char *)MapViewOfFile(resource->mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!resource->mapping || !resource->data)
+        {
+            fprintf(stderr, "MapViewOfFile: error on `%s`\n", resource->path.c_str());
+            if(resource->mapping) CloseHandle(resource->mapping);
+            CloseHandle(file);
+            return false;
+        }
     }
 
-    // get file size
-    *len = ftell(fh);
-    if(*len == -1L)
+    // the view keeps the file open
+    CloseHandle(file);
+    return true;
+}
+
+void ResourceManager::Unmap(Resource *resource)
+{
+    if(resource->data != empty_data) UnmapViewOfFile(resource->data);
+    if(resource->mapping) CloseHandle(resource->mapping);
+}
+#else
+bool ResourceManager::Map(Resource *resource)
+{
+    int fd = open(resource->path.c_str(), O_RDONLY);
+    if(fd < 0)
     {
-        fprintf(stderr, "ftell: error\n");
-        return NULL;
+        fprintf(stderr, "open: error opening `%s`: %s\n", resource->path.c_str(), strerror(errno));
+        return false;
     }
 
-    // fseek to start
-    err = fseek(fh, 0L, SEEK_SET);
-    if(err != 0)
+    struct stat st;
+    if(fstat(fd, &st) < 0)
     {
-        fprintf(stderr, "fseek: error\n");
-        return NULL;
+        fprintf(stderr, "fstat: error on `%s`: %s\n", resource->path.c_str(), strerror(errno));
+        close(fd);
+        return false;
     }
 
-    // allocate buffer
-    buffer = (char *)malloc(*len);
-    if(buffer == NULL)
+    resource->size = st.st_size;
+    resource->data = empty_data;
+
+    if(resource->size > 0)
     {
-        fprintf(stderr, "malloc: error\n");
-        return NULL;
+        // pages are read in as they are first touched, nothing is copied
+        void *data = mmap(NULL, resource->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED)
+        {
+            fprintf(stderr, "mmap: error on `%s`: %s\n", resource->path.c_str(), strerror(errno));
+            close(fd);
+            return false;
+        }
+        resource->data = (const char *)data;
     }
 
-    // read into buffer
-    err = fread(buffer, *len, 1, fh);
-    if(err != 1)
+    // the mapping keeps the file open
+    close(fd);
+    return true;
+}
+
+void ResourceManager::Unmap(Resource *resource)
+{
+    if(resource->data != empty_data) munmap((void *)resource->data, resource->size);
+}
+#endif
+
+bool ResourceManager::Mount(const char *path)
+{
+    Unmount();
+
+    // an archive is optional, so a missing one is not an error
+    SDL_RWops *rw = SDL_RWFromFile(path, "rb");
+    if(!rw) return false;
+    SDL_RWclose(rw);
+
+    AssetArchive *mounted = new AssetArchive;
+    if(!mounted->Open(path))
     {
-        fprintf(stderr, "fread: error\n");
+        delete mounted;
+        return false;
+    }
+    archive = mounted;
+    return true;
+}
+
+void ResourceManager::Unmount(void)
+{
+    // files already loaded from the archive hold on to its mapping
+    delete archive;
+    archive = NULL;
+}
+
+bool ResourceManager::MapArchive(Resource *resource)
+{
+    if(!archive) return false;
+
+    const AssetEntry *entry = archive->Find(resource->path.c_str());
+    if(!entry) return false;
+
+    const char *payload = archive->GetPayload(entry);
+    resource->size = entry->size;
+
+    if(entry->flags & ASSET_COMPRESSED)
+    {
+        unsigned char *data = (unsigned char *)malloc(entry->size ? entry->size : 1);
+        if(!AssetArchive::Decompress((const unsigned char *)payload, entry->stored_size, data, entry->size))
+        {
+            fprintf(stderr, "AssetArchive: `%s` is corrupt\n", resource->path.c_str());
+            free(data);
+            return false;
+        }
+        resource->data = (const char *)data;
+        resource->b_owned = true;
+        return true;
+    }
+
+    resource->parent = archive->GetFile();
+    SDL_AtomicLock(&lock);
+    ++resource->parent->refs;
+    SDL_AtomicUnlock(&lock);
+
+    resource->data = payload;
+    return true;
+}
+
+void ResourceManager::Free(Resource *resource)
+{
+    if(resource->parent) Release(resource->parent);
+    else if(resource->b_owned) free((void *)resource->data);
+    else Unmap(resource);
+}
+
+Resource * ResourceManager::Load(const char *path)
+{
+    PROFILE_ZONE("ResourceManager::Load");
+
+    SDL_AtomicLock(&lock);
+    std::map<std::string, Resource *>::iterator i = cache.find(path);
+    if(i != cache.end())
+    {
+        ++i->second->refs;
+        SDL_AtomicUnlock(&lock);
+        return i->second;
+    }
+    SDL_AtomicUnlock(&lock);
+
+    // map outside the lock, another thread may get there first
+    Resource *resource = new Resource;
+    resource->path = path;
+    if(!MapArchive(resource) && !Map(resource))
+    {
+        delete resource;
         return NULL;
     }
 
-    // close file
-    err = fclose(fh);
-    if(err == EOF) fprintf(stderr, "fclose: error\n");
+    SDL_AtomicLock(&lock);
+    i = cache.find(path);
+    if(i != cache.end())
+    {
+        ++i->second->refs;
+        SDL_AtomicUnlock(&lock);
+
+        Free(resource);
+        delete resource;
+        return i->second;
+    }
+
+    resource->refs = 1;
+    cache[resource->path] = resource;
+    SDL_AtomicUnlock(&lock);
 
-    return buffer;
+    return resource;
+}
+
+void ResourceManager::Release(Resource *resource)
+{
+    if(!resource) return;
+
+    SDL_AtomicLock(&lock);
+    bool b_last = --resource->refs == 0;
+    if(b_last) cache.erase(resource->path);
+    SDL_AtomicUnlock(&lock);
+
+    if(b_last)
+    {
+        Free(resource);
+        delete resource;
+    }
 }
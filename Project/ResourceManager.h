@@ -17,10 +17,72 @@
 #ifndef RESOURCEMANAGER_H
 #define RESOURCEMANAGER_H
 
+#include <map>
+#include <string>
+
+#include <SDL.h>
+
+class AssetArchive;
+
+/* a whole file mapped read-only, shared by every Load of the same path
+ * the data is not null terminated, always use it with GetSize
+ */
+class Resource
+{
+    friend class ResourceManager;
+protected:
+    std::string path;
+    const char *data;
+    long size;
+
+    // guarded by the cache lock of ResourceManager
+    int refs;
+
+    // the mounted archive for a file found in it, its data points into the archive or into
+    // a buffer of its own if the entry was compressed
+    Resource *parent;
+    bool b_owned;
+
+#if defined(_WIN32)
+    void *mapping;
+#endif
+
+    Resource() : data(NULL), size(0), refs(0), parent(NULL), b_owned(false) {}
+public:
+    inline const char * GetData(void) const { return this->data; }
+    inline long GetSize(void) const { return this->size; }
+    inline const std::string & GetPath(void) const { return this->path; }
+};
+
 class ResourceManager
 {
+protected:
+    // mapped files by path, a path is mapped at most once
+    static std::map<std::string, Resource *> cache;
+    static SDL_SpinLock lock;
+
+    // searched before loose files when mounted
+    static AssetArchive *archive;
+
+    static bool Map(Resource *resource);
+    static void Unmap(Resource *resource);
+
+    // the file at resource->path from the archive, false if it is not in it
+    static bool MapArchive(Resource *resource);
+
+    static void Free(Resource *resource);
 public:
-    static char * Load(const char *path, long *len);
+    /* resolves every later Load through the archive at path first, one mapping for all its files
+     * false if there is no archive there, call before any Load from another thread
+     */
+    static bool Mount(const char *path);
+    static void Unmount(void);
+
+    // maps path or shares its existing mapping, NULL on error, safe from any thread
+    static Resource * Load(const char *path);
+
+    // drops a reference, the last one unmaps the file and frees its pages
+    static void Release(Resource *resource);
 };
 
 #endif
@@ -0,0 +1,345 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ShaderBuilder.h"
+#include "ResourceManager.h"
+#include "ProgramCache.h"
+
+bool ShaderBuilder::b_checked = false;
+bool ShaderBuilder::b_parallel = false;
+
+#if defined(_WIN32) || defined(__linux__)
+typedef void (GLAPIENTRY *MaxShaderCompilerThreadsProc)(GLuint count);
+#endif
+
+#define GAME_DOMAIN "ShaderBuilder::PrintLog"
+void ShaderBuilder::PrintLog(GLuint id)
+{
+    GLint max_len = 0;
+    GLint log_len = 0;
+    ASSERT_GL(unsigned char is_shader = glIsShader(id))
+
+    if(is_shader)
+    {
+        ASSERT_GL(glGetShaderiv(id, GL_INFO_LOG_LENGTH, &max_len))
+    }
+    else
+    {
+        ASSERT_GL(glGetProgramiv(id, GL_INFO_LOG_LENGTH, &max_len))
+    }
+
+    if(max_len <= 0) return;
+
+    GLchar *message = (GLchar *)malloc(sizeof(GLchar) * max_len);
+
+    if(is_shader)
+    {
+        ASSERT_GL(glGetShaderInfoLog(id, max_len, &log_len, message))
+    }
+    else
+    {
+        ASSERT_GL(glGetProgramInfoLog(id, max_len, &log_len, message))
+    }
+
+    fprintf(stderr, "%s\n", message);
+    free(message);
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ShaderBuilder::~ShaderBuilder"
+ShaderBuilder::~ShaderBuilder()
+{
+    // programs nobody took, including those built next to one that failed
+    for(size_t i=0; i<this->builds.size(); ++i)
+    {
+        ShaderBuild &b = this->builds[i];
+        if(b.v_id)
+        {
+            ASSERT_GL(glDeleteShader(b.v_id))
+        }
+        if(b.f_id)
+        {
+            ASSERT_GL(glDeleteShader(b.f_id))
+        }
+        if(b.program)
+        {
+            ASSERT_GL(glDeleteProgram(b.program->id))
+            delete b.program;
+        }
+        else if(b.program_id)
+        {
+            ASSERT_GL(glDeleteProgram(b.program_id))
+        }
+    }
+}
+#undef GAME_DOMAIN
+
+ShaderProgram * ShaderBuilder::Take(int index)
+{
+    ShaderBuild &b = this->builds[index];
+    ShaderProgram *program = b.program;
+    b.program = NULL;
+    b.program_id = 0;
+    return program;
+}
+
+int ShaderBuilder::Add(const char *v_path, const char *f_path, const char **varyings, GLsizei num_varyings,
+                       const char **attribs, GLsizei num_attribs)
+{
+    ShaderBuild build;
+    build.v_path = v_path;
+    build.f_path = f_path;
+    build.varyings = varyings;
+    build.num_varyings = num_varyings;
+    build.attribs = attribs;
+    build.num_attribs = num_attribs;
+    build.key = 0;
+    build.v_id = 0;
+    build.f_id = 0;
+    build.program_id = 0;
+    build.b_cached = false;
+    build.b_failed = false;
+    build.program = NULL;
+
+    this->builds.push_back(build);
+    return (int)this->builds.size() - 1;
+}
+
+#define GAME_DOMAIN "ShaderBuilder::Compile"
+GLuint ShaderBuilder::Compile(GLenum type, Resource *resource)
+{
+    // GL copies the source, the mapping can go as soon as it is handed over
+    const char *src = resource->GetData();
+    GLint len = resource->GetSize();
+
+    ASSERT_GL(GLuint id = glCreateShader(type))
+    ASSERT_GL(glShaderSource(id, 1, &src, &len))
+    ASSERT_GL(glCompileShader(id))
+    return id;
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ShaderBuilder::Submit"
+void ShaderBuilder::Submit(void)
+{
+    PROFILE_ZONE("ShaderBuilder::Submit");
+
+    if(!b_checked)
+    {
+        b_checked = true;
+
+        // GLEW does not know these extensions yet, so look for them by name
+        b_parallel = GLDebug::HasExtension("GL_KHR_parallel_shader_compile") ||
+                     GLDebug::HasExtension("GL_ARB_parallel_shader_compile");
+
+#if defined(_WIN32) || defined(__linux__)
+        // let the driver use as many threads as it likes, some default to none
+        MaxShaderCompilerThreadsProc max_threads = NULL;
+        if(b_parallel)
+        {
+            max_threads = (MaxShaderCompilerThreadsProc)SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsKHR");
+            if(!max_threads)
+            {
+                max_threads = (MaxShaderCompilerThreadsProc)SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsARB");
+            }
+        }
+        if(max_threads)
+        {
+            ASSERT_GL(max_threads(0xFFFFFFFF))
+        }
+#endif
+    }
+
+    this->submit_start = Profiler::Now();
+
+    // every compile first, the driver can start on them while the rest are handed over
+    for(size_t i=0; i<this->builds.size(); ++i)
+    {
+        ShaderBuild &b = this->builds[i];
+
+        Resource *v_res = ResourceManager::Load(b.v_path);
+        Resource *f_res = b.f_path ? ResourceManager::Load(b.f_path) : NULL;
+        if(!v_res || (b.f_path && !f_res))
+        {
+            fprintf(stderr, "ShaderBuilder: error: failed to load `%s`\n", v_res ? b.f_path : b.v_path);
+            ResourceManager::Release(v_res);
+            ResourceManager::Release(f_res);
+            b.b_failed = true;
+            continue;
+        }
+
+        const char *sources[2] = { v_res->GetData(), f_res ? f_res->GetData() : NULL };
+        GLint lengths[2] = { (GLint)v_res->GetSize(), f_res ? (GLint)f_res->GetSize() : 0 };
+        b.key = ProgramCache::Key(sources, lengths, f_res ? 2 : 1, b.varyings, b.num_varyings,
+                                  b.attribs, b.num_attribs);
+
+        // a warm start links straight from the driver's binary
+        if((b.program_id = ProgramCache::Load(b.key))) b.b_cached = true;
+        else
+        {
+            b.v_id = Compile(GL_VERTEX_SHADER, v_res);
+
+            // transform feedback programs may have no fragment stage
+            if(f_res) b.f_id = Compile(GL_FRAGMENT_SHADER, f_res);
+        }
+
+        ResourceManager::Release(v_res);
+        ResourceManager::Release(f_res);
+    }
+
+    // then every link, a link of a shader that failed to compile fails and is reported in Finish
+    for(size_t i=0; i<this->builds.size(); ++i)
+    {
+        ShaderBuild &b = this->builds[i];
+        if(b.b_failed || b.b_cached) continue;
+
+        ASSERT_GL(b.program_id = glCreateProgram())
+        ASSERT_GL(glAttachShader(b.program_id, b.v_id))
+        if(b.f_id)
+        {
+            ASSERT_GL(glAttachShader(b.program_id, b.f_id))
+        }
+
+        if(b.num_varyings > 0)
+        {
+            ASSERT_GL(glTransformFeedbackVaryings(b.program_id, b.num_varyings, b.varyings, GL_INTERLEAVED_ATTRIBS))
+        }
+
+        for(GLsizei a=0; a<b.num_attribs; ++a)
+        {
+            ASSERT_GL(glBindAttribLocation(b.program_id, a, b.attribs[a]))
+        }
+
+        ProgramCache::Prepare(b.program_id);
+        ASSERT_GL(glLinkProgram(b.program_id))
+    }
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ShaderBuilder::IsComplete"
+bool ShaderBuilder::IsComplete(GLuint id, bool b_program)
+{
+    if(!b_parallel) return true;
+
+    GLint complete = GL_TRUE;
+    if(b_program)
+    {
+        ASSERT_GL(glGetProgramiv(id, GL_COMPLETION_STATUS_KHR, &complete))
+    }
+    else
+    {
+        ASSERT_GL(glGetShaderiv(id, GL_COMPLETION_STATUS_KHR, &complete))
+    }
+    return complete != GL_FALSE;
+}
+#undef GAME_DOMAIN
+
+bool ShaderBuilder::IsDone(void)
+{
+    for(size_t i=0; i<this->builds.size(); ++i)
+    {
+        const ShaderBuild &b = this->builds[i];
+        if(!b.b_failed && !IsComplete(b.program_id, true)) return false;
+    }
+    return true;
+}
+
+#define GAME_DOMAIN "ShaderBuilder::Finish"
+bool ShaderBuilder::Finish(void)
+{
+    PROFILE_ZONE("ShaderBuilder::Finish");
+
+    // with parallel compile the status queries below would block, so wait without them
+    while(!this->IsDone()) SDL_Delay(1);
+
+    bool b_ok = true;
+    unsigned int num_cached = 0;
+    for(size_t i=0; i<this->builds.size(); ++i)
+    {
+        ShaderBuild &b = this->builds[i];
+        if(b.b_cached) ++num_cached;
+
+        GLint status = GL_FALSE;
+        if(!b.b_failed && !b.b_cached)
+        {
+            ASSERT_GL(glGetShaderiv(b.v_id, GL_COMPILE_STATUS, &status))
+            if(!status)
+            {
+                fprintf(stderr, "glCompileShader(v_id): error in `%s`\n", b.v_path);
+                PrintLog(b.v_id);
+                b.b_failed = true;
+            }
+        }
+
+        if(!b.b_failed && b.f_id)
+        {
+            ASSERT_GL(glGetShaderiv(b.f_id, GL_COMPILE_STATUS, &status))
+            if(!status)
+            {
+                fprintf(stderr, "glCompileShader(f_id): error in `%s`\n", b.f_path);
+                PrintLog(b.f_id);
+                b.b_failed = true;
+            }
+        }
+
+        if(!b.b_failed)
+        {
+            ASSERT_GL(glGetProgramiv(b.program_id, GL_LINK_STATUS, &status))
+            if(!status)
+            {
+                fprintf(stderr, "glLinkProgram: error in `%s` and `%s`\n", b.v_path, b.f_path ? b.f_path : "(none)");
+                PrintLog(b.program_id);
+                b.b_failed = true;
+            }
+        }
+
+        // a linked program keeps what it needs from its shaders
+        if(b.v_id)
+        {
+            ASSERT_GL(glDeleteShader(b.v_id))
+        }
+        if(b.f_id)
+        {
+            ASSERT_GL(glDeleteShader(b.f_id))
+        }
+        b.v_id = b.f_id = 0;
+
+        if(b.b_failed)
+        {
+            if(b.program_id)
+            {
+                ASSERT_GL(glDeleteProgram(b.program_id))
+            }
+            b.program_id = 0;
+            b_ok = false;
+            continue;
+        }
+
+        if(!b.b_cached) ProgramCache::Store(b.key, b.program_id);
+
+        // look up every uniform, attribute and block once
+        b.program = new ShaderProgram(b.program_id);
+        b.program->Reflect();
+    }
+
+    printf("ShaderBuilder: %u programs, %u from cache, in %.1f ms%s\n", (unsigned int)this->builds.size(), num_cached,
+           Profiler::ToMilliseconds(Profiler::Now() - this->submit_start), b_parallel ? " with parallel compile" : "");
+    return b_ok;
+}
+#undef GAME_DOMAIN
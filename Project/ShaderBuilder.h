@@ -0,0 +1,102 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef SHADERBUILDER_H
+#define SHADERBUILDER_H
+
+#include <vector>
+
+#include "common.h"
+#include "ShaderProgram.h"
+
+// KHR_parallel_shader_compile, missing from older GLEW headers
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+class Resource;
+
+struct ShaderBuild
+{
+    const char *v_path;
+    const char *f_path;
+    const char **varyings;
+    GLsizei num_varyings;
+    const char **attribs;
+    GLsizei num_attribs;
+
+    Uint64 key;
+    GLuint v_id;
+    GLuint f_id;
+    GLuint program_id;
+
+    // linked from the program cache, nothing was compiled
+    bool b_cached;
+    bool b_failed;
+
+    ShaderProgram *program;
+};
+
+/* compiles and links a batch of programs together
+ * every shader and program is handed to the driver before any status is read, so its compiler
+ * threads work on all of them at once instead of one stage at a time
+ */
+class ShaderBuilder
+{
+protected:
+    std::vector<ShaderBuild> builds;
+    Uint64 submit_start;
+
+    static bool b_checked;
+    static bool b_parallel;
+
+    static GLuint Compile(GLenum type, Resource *resource);
+
+    // true once the driver has finished with a shader or program, without blocking on it
+    static bool IsComplete(GLuint id, bool b_program);
+public:
+    ShaderBuilder() : submit_start(0) {}
+
+    // deletes every program that was not taken
+    ~ShaderBuilder();
+
+    // prints the info log of a shader or program
+    static void PrintLog(GLuint id);
+
+    /* f_path may be NULL, varyings are captured with transform feedback and attribs are bound to
+     * their index before linking, returns the index for Get
+     */
+    int Add(const char *v_path, const char *f_path, const char **varyings = NULL, GLsizei num_varyings = 0,
+            const char **attribs = NULL, GLsizei num_attribs = 0);
+
+    // starts every compile and link, the caller may do other work before Finish
+    void Submit(void);
+
+    // true once the driver has finished every program, always true without parallel compile
+    bool IsDone(void);
+
+    // waits for and checks every program, false if any of them failed
+    bool Finish(void);
+
+    // the built program, still owned by the builder, NULL if it failed
+    inline ShaderProgram * Get(int index) { return this->builds[index].program; }
+
+    // the built program, owned by the caller from now on, NULL if it failed
+    ShaderProgram * Take(int index);
+};
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "ShaderProgram.h"
+
+const char *ShaderProgram::uniform_names[NUM_SHADER_UNIFORMS] =
+{
+    "u_matProjection",
+    "u_matCamera",
+    "u_matModelView",
+    "u_bHDR",
+    "u_bPoints",
+    "u_nMaterial",
+    "u_fExposure",
+    "u_sDiffuse",
+    "u_sNormalHeight",
+    "u_sSpecular",
+    "u_sNormalHeight2",
+    "u_sClusters",
+    "u_sClusterLights",
+    "u_vScreenSize",
+    "u_fClusterScale",
+    "u_fClusterBias",
+    "u_vLightAmbient",
+    "u_sFBO",
+    "u_bEnabled",
+    "u_vVelocity",
+    "u_fTimestep",
+    "u_vBoundsMin",
+    "u_vBoundsMax",
+};
+
+const char *ShaderProgram::attrib_names[NUM_SHADER_ATTRIBS] =
+{
+    "a_vVertex",
+    "a_vNormal",
+    "a_vTangent",
+    "a_vBitangent",
+    "a_vTexCoord",
+    "a_fPointSize",
+    "a_fRotation",
+    "a_vOffset",
+    "a_vCoord",
+};
+
+const char *ShaderProgram::block_names[NUM_SHADER_BLOCKS] =
+{
+    "LightTypesBlock",
+    "LightsBlock",
+    "MaterialsBlock",
+};
+
+bool ShaderProgram::b_separate = false;
+
+void ShaderProgram::Init(void)
+{
+#if defined(_WIN32) || defined(__linux__)
+    b_separate = GLEW_ARB_separate_shader_objects || GLEW_VERSION_4_1;
+#else
+    b_separate = true;
+#endif
+}
+
+GLint ShaderProgram::Find(const std::map<std::string, ShaderVariable> &vars, const char *name)
+{
+    std::map<std::string, ShaderVariable>::const_iterator i = vars.find(name);
+    return i == vars.end() ? -1 : i->second.location;
+}
+
+#define GAME_DOMAIN "ShaderProgram::Reflect"
+void ShaderProgram::Reflect(void)
+{
+    GLint count, max_len;
+    ShaderVariable var;
+
+    // uniforms in the default block
+    ASSERT_GL(glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count))
+    ASSERT_GL(glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_len))
+
+    GLchar *name = (GLchar *)malloc(max_len + 1);
+    for(GLint i=0; i<count; ++i)
+    {
+        ASSERT_GL(glGetActiveUniform(id, i, max_len + 1, NULL, &var.size, &var.type, name))
+        ASSERT_GL(var.location = glGetUniformLocation(id, name))
+
+        // members of uniform blocks have no location
+        if(var.location < 0) continue;
+
+        // arrays are reported as "name[0]", also cache them as "name"
+        char *bracket = strstr(name, "[0]");
+        uniforms[name] = var;
+        if(bracket)
+        {
+            *bracket = '\0';
+            uniforms[name] = var;
+        }
+    }
+    free(name);
+
+    // vertex attributes
+    ASSERT_GL(glGetProgramiv(id, GL_ACTIVE_ATTRIBUTES, &count))
+    ASSERT_GL(glGetProgramiv(id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_len))
+
+    name = (GLchar *)malloc(max_len + 1);
+    for(GLint i=0; i<count; ++i)
+    {
+        ASSERT_GL(glGetActiveAttrib(id, i, max_len + 1, NULL, &var.size, &var.type, name))
+        ASSERT_GL(var.location = glGetAttribLocation(id, name))
+        attribs[name] = var;
+    }
+    free(name);
+
+    // uniform blocks
+    ASSERT_GL(glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &count))
+    ASSERT_GL(glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_len))
+
+    name = (GLchar *)malloc(max_len + 1);
+    for(GLint i=0; i<count; ++i)
+    {
+        ASSERT_GL(glGetActiveUniformBlockName(id, i, max_len + 1, NULL, name))
+        ASSERT_GL(glGetActiveUniformBlockiv(id, i, GL_UNIFORM_BLOCK_DATA_SIZE, &var.size))
+        var.location = i;
+        var.type = 0;
+        blocks[name] = var;
+    }
+    free(name);
+
+    // resolve the compile-time ids
+    for(unsigned int i=0; i<NUM_SHADER_UNIFORMS; ++i) uniform_ids[i] = Uniform(uniform_names[i]);
+    for(unsigned int i=0; i<NUM_SHADER_ATTRIBS; ++i) attrib_ids[i] = Attrib(attrib_names[i]);
+    for(unsigned int i=0; i<NUM_SHADER_BLOCKS; ++i) block_ids[i] = Block(block_names[i]);
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ShaderProgram::Bind"
+GLint ShaderProgram::Bind(void)
+{
+    GLint previous = 0;
+    ASSERT_GL(glGetIntegerv(GL_CURRENT_PROGRAM, &previous))
+    if((GLuint)previous != this->id)
+    {
+        ASSERT_GL(glUseProgram(this->id))
+    }
+    return previous;
+}
+
+void ShaderProgram::Unbind(GLint previous)
+{
+    if((GLuint)previous != this->id)
+    {
+        ASSERT_GL(glUseProgram(previous))
+    }
+}
+#undef GAME_DOMAIN
+
+#define GAME_DOMAIN "ShaderProgram::SetUniform"
+void ShaderProgram::SetUniform1i(ShaderUniform uniform, GLint v)
+{
+    if(b_separate)
+    {
+        ASSERT_GL(glProgramUniform1i(this->id, Uniform(uniform), v))
+        return;
+    }
+
+    GLint previous = this->Bind();
+    ASSERT_GL(glUniform1i(Uniform(uniform), v))
+    this->Unbind(previous);
+}
+
+void ShaderProgram::SetUniform1f(ShaderUniform uniform, GLfloat v)
+{
+    if(b_separate)
+    {
+        ASSERT_GL(glProgramUniform1f(this->id, Uniform(uniform), v))
+        return;
+    }
+
+    GLint previous = this->Bind();
+    ASSERT_GL(glUniform1f(Uniform(uniform), v))
+    this->Unbind(previous);
+}
+
+void ShaderProgram::SetUniform2f(ShaderUniform uniform, GLfloat x, GLfloat y)
+{
+    if(b_separate)
+    {
+        ASSERT_GL(glProgramUniform2f(this->id, Uniform(uniform), x, y))
+        return;
+    }
+
+    GLint previous = this->Bind();
+    ASSERT_GL(glUniform2f(Uniform(uniform), x, y))
+    this->Unbind(previous);
+}
+
+void ShaderProgram::SetUniform3fv(ShaderUniform uniform, GLsizei count, const GLfloat *v)
+{
+    if(b_separate)
+    {
+        ASSERT_GL(glProgramUniform3fv(this->id, Uniform(uniform), count, v))
+        return;
+    }
+
+    GLint previous = this->Bind();
+    ASSERT_GL(glUniform3fv(Uniform(uniform), count, v))
+    this->Unbind(previous);
+}
+
+void ShaderProgram::SetUniform4fv(ShaderUniform uniform, GLsizei count, const GLfloat *v)
+{
+    if(b_separate)
+    {
+        ASSERT_GL(glProgramUniform4fv(this->id, Uniform(uniform), count, v))
+        return;
+    }
+
+    GLint previous = this->Bind();
+    ASSERT_GL(glUniform4fv(Uniform(uniform), count, v))
+    this->Unbind(previous);
+}
+
+void ShaderProgram::SetUniformMatrix4fv(ShaderUniform uniform, GLsizei count, const GLfloat *v)
+{
+    if(b_separate)
+    {
+        ASSERT_GL(glProgramUniformMatrix4fv(this->id, Uniform(uniform), count, GL_FALSE, v))
+        return;
+    }
+
+    GLint previous = this->Bind();
+    ASSERT_GL(glUniformMatrix4fv(Uniform(uniform), count, GL_FALSE, v))
+    this->Unbind(previous);
+}
+#undef GAME_DOMAIN
@@ -0,0 +1,139 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef SHADERPROGRAM_H
+#define SHADERPROGRAM_H
+
+#include <map>
+#include <string>
+
+#include "common.h"
+
+/* compile-time ids for the uniforms, attributes and blocks used by the game
+ * the matching names are in ShaderProgram.cpp, keep both lists in order
+ */
+enum ShaderUniform
+{
+    UNIFORM_MAT_PROJECTION,
+    UNIFORM_MAT_CAMERA,
+    UNIFORM_MAT_MODELVIEW,
+    UNIFORM_B_HDR,
+    UNIFORM_B_POINTS,
+    UNIFORM_N_MATERIAL,
+    UNIFORM_F_EXPOSURE,
+    UNIFORM_S_DIFFUSE,
+    UNIFORM_S_NORMALHEIGHT,
+    UNIFORM_S_SPECULAR,
+    UNIFORM_S_NORMALHEIGHT2,
+    UNIFORM_S_CLUSTERS,
+    UNIFORM_S_CLUSTERLIGHTS,
+    UNIFORM_V_SCREENSIZE,
+    UNIFORM_F_CLUSTERSCALE,
+    UNIFORM_F_CLUSTERBIAS,
+    UNIFORM_V_LIGHTAMBIENT,
+    UNIFORM_S_FBO,
+    UNIFORM_B_ENABLED,
+    UNIFORM_V_VELOCITY,
+    UNIFORM_F_TIMESTEP,
+    UNIFORM_V_BOUNDSMIN,
+    UNIFORM_V_BOUNDSMAX,
+    NUM_SHADER_UNIFORMS
+};
+
+enum ShaderAttrib
+{
+    ATTRIB_VERTEX,
+    ATTRIB_NORMAL,
+    ATTRIB_TANGENT,
+    ATTRIB_BITANGENT,
+    ATTRIB_TEXCOORD,
+    ATTRIB_POINTSIZE,
+    ATTRIB_ROTATION,
+    ATTRIB_OFFSET,
+    ATTRIB_COORD,
+    NUM_SHADER_ATTRIBS
+};
+
+enum ShaderBlock
+{
+    BLOCK_LIGHT_TYPES,
+    BLOCK_LIGHTS,
+    BLOCK_MATERIALS,
+    NUM_SHADER_BLOCKS
+};
+
+struct ShaderVariable
+{
+    GLint location;     // block index for uniform blocks
+    GLenum type;        // 0 for uniform blocks
+    GLint size;         // array size, or data size in bytes for uniform blocks
+};
+
+class ShaderProgram
+{
+protected:
+    std::map<std::string, ShaderVariable> uniforms;
+    std::map<std::string, ShaderVariable> attribs;
+    std::map<std::string, ShaderVariable> blocks;
+
+    GLint uniform_ids[NUM_SHADER_UNIFORMS];
+    GLint attrib_ids[NUM_SHADER_ATTRIBS];
+    GLint block_ids[NUM_SHADER_BLOCKS];
+
+    // glProgramUniform* is GL 4.1 or ARB_separate_shader_objects, the context only promises 3.2
+    static bool b_separate;
+
+    static GLint Find(const std::map<std::string, ShaderVariable> &vars, const char *name);
+
+    // binds this program for a glUniform* call without the separate API, returns the one to restore
+    GLint Bind(void);
+    void Unbind(GLint previous);
+public:
+    static const char *uniform_names[NUM_SHADER_UNIFORMS];
+    static const char *attrib_names[NUM_SHADER_ATTRIBS];
+    static const char *block_names[NUM_SHADER_BLOCKS];
+
+    GLuint id;
+
+    ShaderProgram(GLuint id) : id(id) {}
+
+    // picks the uniform setters the driver supports, call once after glewInit
+    static void Init(void);
+
+    // query every active uniform, attribute and uniform block, call once after linking
+    void Reflect(void);
+
+    inline GLint Uniform(ShaderUniform uniform) const { return uniform_ids[uniform]; }
+    inline GLint Attrib(ShaderAttrib attrib) const { return attrib_ids[attrib]; }
+    inline GLint Block(ShaderBlock block) const { return block_ids[block]; }
+
+    // name lookups hit the cache built by Reflect, -1 if not active
+    inline GLint Uniform(const char *name) const { return Find(uniforms, name); }
+    inline GLint Attrib(const char *name) const { return Find(attribs, name); }
+    inline GLint Block(const char *name) const { return Find(blocks, name); }
+
+    /* set a uniform of this program whichever program is bound, through glProgramUniform* where
+     * the driver has it and otherwise by binding this program around glUniform*
+     */
+    void SetUniform1i(ShaderUniform uniform, GLint v);
+    void SetUniform1f(ShaderUniform uniform, GLfloat v);
+    void SetUniform2f(ShaderUniform uniform, GLfloat x, GLfloat y);
+    void SetUniform3fv(ShaderUniform uniform, GLsizei count, const GLfloat *v);
+    void SetUniform4fv(ShaderUniform uniform, GLsizei count, const GLfloat *v);
+    void SetUniformMatrix4fv(ShaderUniform uniform, GLsizei count, const GLfloat *v);
+};
+
+#endif
@@ -17,18 +17,125 @@
 #ifndef TEXTUREMANAGER_H
 #define TEXTUREMANAGER_H
 
+#include <string.h>
+#include <vector>
+
+#include "common.h"
+#include "ResourceManager.h"
+
+// a decoded image as RGBA bytes with its whole mip chain
+struct TextureImage
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+
+    // byte offset of each level in pixels, level 0 first
+    std::vector<size_t> levels;
+
+    inline int LevelWidth(int level) const { return (this->width >> level) > 1 ? this->width >> level : 1; }
+    inline int LevelHeight(int level) const { return (this->height >> level) > 1 ? this->height >> level : 1; }
+    inline int GetNumLevels(void) const { return (int)this->levels.size(); }
+};
+
 class TextureManager
 {
 public:
-#define GAME_DOMAIN "TextureManager::LoadBMP"
-    static GLuint LoadBMP(const char *path, GLenum texture_unit, GLfloat aniso,
-                          bool flip_x = false, bool flip_y = false)
+    /* reads and decodes a BMP into level 0 of image, no GL calls so it is safe from any thread
+     * flipping mirrors the image in place of the old FlipSurface
+     */
+    static bool DecodeBMP(const char *path, TextureImage *image, bool flip_x = false, bool flip_y = false)
     {
-        SDL_Surface *texture = SDL_LoadBMP(path);
-        if(flip_x || flip_y) texture = FlipSurface(texture, flip_x, flip_y);
+        PROFILE_ZONE("TextureManager::DecodeBMP");
 
-        ASSERT_GL(glActiveTexture(texture_unit))
+        // decode straight from the mapped file
+        Resource *resource = ResourceManager::Load(path);
+        if(!resource) return false;
+
+        SDL_Surface *bmp = SDL_LoadBMP_RW(SDL_RWFromConstMem(resource->GetData(), resource->GetSize()), 1);
+        ResourceManager::Release(resource);
+        if(!bmp)
+        {
+            fprintf(stderr, "SDL_LoadBMP_RW: error in `%s`: %s\n", path, SDL_GetError());
+            return false;
+        }
+
+        // R, G, B, A in memory whatever the BMP held
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+        SDL_Surface *rgba = SDL_ConvertSurfaceFormat(bmp, SDL_PIXELFORMAT_RGBA8888, 0);
+#else
+        SDL_Surface *rgba = SDL_ConvertSurfaceFormat(bmp, SDL_PIXELFORMAT_ABGR8888, 0);
+#endif
+        SDL_FreeSurface(bmp);
+        if(!rgba)
+        {
+            fprintf(stderr, "SDL_ConvertSurfaceFormat: error in `%s`: %s\n", path, SDL_GetError());
+            return false;
+        }
+
+        image->width = rgba->w;
+        image->height = rgba->h;
+        image->pixels.resize((size_t)rgba->w * rgba->h * 4);
+        image->levels.assign(1, 0);
+
+        if(SDL_MUSTLOCK(rgba)) SDL_LockSurface(rgba);
+
+        for(int y=0; y<rgba->h; ++y)
+        {
+            const Uint32 *src = (const Uint32 *)((const char *)rgba->pixels + y * rgba->pitch);
+            Uint32 *dst = (Uint32 *)&image->pixels[(size_t)(flip_y ? rgba->h - 1 - y : y) * rgba->w * 4];
+            if(!flip_x) memcpy(dst, src, rgba->w * 4);
+            else for(int x=0, rx=rgba->w-1; x<rgba->w; ++x, --rx) dst[rx] = src[x];
+        }
+
+        if(SDL_MUSTLOCK(rgba)) SDL_UnlockSurface(rgba);
+        SDL_FreeSurface(rgba);
+        return true;
+    }
+
+    // appends every level below level 0 down to 1x1, each texel the box average of the level above
+    static void BuildMipmaps(TextureImage *image)
+    {
+        PROFILE_ZONE("TextureManager::BuildMipmaps");
+
+        image->levels.resize(1);
+        size_t size = image->pixels.size();
+        for(int w=image->width, h=image->height; w > 1 || h > 1; w = w > 1 ? w / 2 : 1, h = h > 1 ? h / 2 : 1)
+        {
+            image->levels.push_back(size);
+            size += (size_t)(w > 1 ? w / 2 : 1) * (h > 1 ? h / 2 : 1) * 4;
+        }
+        image->pixels.resize(size);
+
+        for(int level=1; level<image->GetNumLevels(); ++level)
+        {
+            int src_w = image->LevelWidth(level - 1), src_h = image->LevelHeight(level - 1);
+            int w = image->LevelWidth(level), h = image->LevelHeight(level);
+            const unsigned char *src = &image->pixels[image->levels[level - 1]];
+            unsigned char *dst = &image->pixels[image->levels[level]];
 
+            for(int y=0; y<h; ++y)
+            {
+                // an odd edge of one texel is averaged with itself
+                const unsigned char *row0 = src + (size_t)(2 * y) * src_w * 4;
+                const unsigned char *row1 = src + (size_t)(2 * y + 1 < src_h ? 2 * y + 1 : 2 * y) * src_w * 4;
+                for(int x=0; x<w; ++x)
+                {
+                    int x0 = 2 * x * 4, x1 = (2 * x + 1 < src_w ? 2 * x + 1 : 2 * x) * 4;
+                    for(int c=0; c<4; ++c)
+                    {
+                        dst[(y * w + x) * 4 + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c]
+                                                                  + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                    }
+                }
+            }
+        }
+    }
+
+#define GAME_DOMAIN "TextureManager::CreateTexture"
+    // a repeating trilinear texture on the active unit with storage for num_levels levels
+    static GLuint CreateTexture(GLfloat aniso, int num_levels)
+    {
         GLuint id;
         ASSERT_GL(glGenTextures(1, &id))
         ASSERT_GL(glBindTexture(GL_TEXTURE_2D, id))
@@ -37,63 +144,59 @@ public:
         ASSERT_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT))
         ASSERT_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR))
         ASSERT_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR))
+        ASSERT_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, num_levels - 1))
 
         ASSERT_GL(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, aniso))
-
-        GLenum format = 0;
-        switch(texture->format->BytesPerPixel)
-        {
-            case 3:
-            format = texture->format->Rmask == 0xFF ? GL_RGB : GL_BGR;
-            break;
-            case 4:
-            format = texture->format->Rmask == 0xFF ? GL_RGBA : GL_BGRA;
-            break;
-        }
-
-        ASSERT_GL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture->w, texture->h, 0, format,
-                               GL_UNSIGNED_BYTE, texture->pixels));
-        ASSERT_GL(glGenerateMipmap(GL_TEXTURE_2D))
-        
-        SDL_FreeSurface(texture);
         return id;
     }
 #undef GAME_DOMAIN
 
-    static Uint32 GetPixel32(SDL_Surface *surface, int x, int y)
+#define GAME_DOMAIN "TextureManager::UploadLevel"
+    // into the texture bound on the active unit
+    static void UploadLevel(const TextureImage &image, int level)
     {
-        Uint32 *pixels = (Uint32 *)surface->pixels;
-        return pixels[(y * surface->w) + x];
+        ASSERT_GL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4))
+        ASSERT_GL(glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, image.LevelWidth(level), image.LevelHeight(level), 0,
+                               GL_RGBA, GL_UNSIGNED_BYTE, &image.pixels[image.levels[level]]))
     }
+#undef GAME_DOMAIN
 
-    static void PutPixel32(SDL_Surface *surface, int x, int y, Uint32 pixel)
+#define GAME_DOMAIN "TextureManager::CreateSolid"
+    // a 1x1 texture of one colour bound on texture_unit, stands in for a texture still loading
+    static GLuint CreateSolid(GLenum texture_unit, const GLubyte rgba[4])
     {
-        Uint32 *pixels = (Uint32 *)surface->pixels;
-        pixels[(y * surface->w) + x] = pixel;
+        ASSERT_GL(glActiveTexture(texture_unit))
+
+        GLuint id;
+        ASSERT_GL(glGenTextures(1, &id))
+        ASSERT_GL(glBindTexture(GL_TEXTURE_2D, id))
+        ASSERT_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT))
+        ASSERT_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT))
+        ASSERT_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST))
+        ASSERT_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST))
+        ASSERT_GL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4))
+        ASSERT_GL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba))
+        return id;
     }
+#undef GAME_DOMAIN
 
-    static SDL_Surface * FlipSurface( SDL_Surface *surface, bool flip_x, bool flip_y)
+#define GAME_DOMAIN "TextureManager::LoadBMP"
+    // decodes and uploads on the calling thread, AssetLoader does the same work off it
+    static GLuint LoadBMP(const char *path, GLenum texture_unit, GLfloat aniso,
+                          bool flip_x = false, bool flip_y = false)
     {
-        SDL_Surface *flipped = NULL;
-        flipped = SDL_CreateRGBSurface(SDL_SWSURFACE, surface->w, surface->h, surface->format->BitsPerPixel, surface->format->Rmask, surface->format->Gmask, surface->format->Bmask, surface->format->Amask);
+        PROFILE_ZONE("TextureManager::LoadBMP");
 
-        if(SDL_MUSTLOCK(surface)) SDL_LockSurface(surface);
+        TextureImage image;
+        if(!DecodeBMP(path, &image, flip_x, flip_y)) return 0;
+        BuildMipmaps(&image);
 
-        for(int x=0, rx=flipped->w-1; x<flipped->w; x++, rx--)
-        {
-            for(int y=0, ry=flipped->h-1; y<flipped->h; y++, ry--)
-            {
-                Uint32 pixel = GetPixel32(surface, x, y );
-
-                if(flip_x && flip_y) PutPixel32(flipped, rx, ry, pixel);
-                else if(flip_x) PutPixel32(flipped, rx, y, pixel);
-                else if(flip_y) PutPixel32(flipped, x, ry, pixel);
-            }
-        }
-        
-        if(SDL_MUSTLOCK(surface)) SDL_UnlockSurface(surface);
-        return flipped;
+        ASSERT_GL(glActiveTexture(texture_unit))
+        GLuint id = CreateTexture(aniso, image.GetNumLevels());
+        for(int level=0; level<image.GetNumLevels(); ++level) UploadLevel(image, level);
+        return id;
     }
+#undef GAME_DOMAIN
 };
 
 #endif
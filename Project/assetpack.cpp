@@ -0,0 +1,269 @@
+/*
+ *  Copyright 2013 David Farrell
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* packs files into an asset archive for ResourceManager::Mount
+ *
+ *   assetpack <archive> <file or directory>...
+ *
+ * files are stored under the path they were given by, files found in a directory under
+ * their path relative to it, so `assetpack assets.pak .` stores `shader.vsh`
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "AssetArchive.h"
+#include "ResourceManager.h"
+
+struct PackFile
+{
+    std::string name;
+    std::string path;
+    Uint64 hash;
+};
+
+static bool ByHash(const PackFile &a, const PackFile &b)
+{
+    return a.hash < b.hash || (a.hash == b.hash && a.name < b.name);
+}
+
+static bool ReadFile(const char *path, std::vector<unsigned char> *data)
+{
+    FILE *fh = fopen(path, "rb");
+    if(!fh)
+    {
+        fprintf(stderr, "assetpack: error opening `%s`\n", path);
+        return false;
+    }
+
+    data->clear();
+    unsigned char buffer[65536];
+    size_t len;
+    while((len = fread(buffer, 1, sizeof(buffer), fh)) > 0) data->insert(data->end(), buffer, buffer + len);
+
+    bool b_ok = !ferror(fh);
+    if(!b_ok) fprintf(stderr, "assetpack: error reading `%s`\n", path);
+    fclose(fh);
+    return b_ok;
+}
+
+// the canonical form of path, empty if it does not exist
+static std::string RealPath(const char *path)
+{
+    char resolved[PATH_MAX];
+    if(!realpath(path, resolved)) return std::string();
+    return resolved;
+}
+
+// adds every regular file under dir, skipping hidden ones and skip, the archive being written
+static bool Walk(const std::string &dir, const std::string &prefix, const std::string &skip,
+                 std::vector<PackFile> *files)
+{
+    DIR *d = opendir(dir.c_str());
+    if(!d)
+    {
+        fprintf(stderr, "assetpack: error opening directory `%s`\n", dir.c_str());
+        return false;
+    }
+
+    bool b_ok = true;
+    for(struct dirent *ent; b_ok && (ent = readdir(d));)
+    {
+        if(ent->d_name[0] == '.') continue;
+
+        std::string path = dir + "/" + ent->d_name;
+        std::string name = prefix + ent->d_name;
+
+        struct stat st;
+        if(stat(path.c_str(), &st) < 0) continue;
+
+        if(S_ISDIR(st.st_mode)) b_ok = Walk(path, name + "/", skip, files);
+        else if(S_ISREG(st.st_mode) && (skip.empty() || RealPath(path.c_str()) != skip))
+        {
+            PackFile file = { name, path, AssetArchive::Hash(name.c_str()) };
+            files->push_back(file);
+        }
+    }
+
+    closedir(d);
+    return b_ok;
+}
+
+static void Pad(FILE *fh, Uint64 *offset)
+{
+    static const char zeros[ASSET_ALIGN] = { 0 };
+    Uint64 pad = (ASSET_ALIGN - *offset % ASSET_ALIGN) % ASSET_ALIGN;
+    fwrite(zeros, 1, (size_t)pad, fh);
+    *offset += pad;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 3)
+    {
+        fprintf(stderr, "usage: %s <archive> <file or directory>...\n", argv[0]);
+        return 1;
+    }
+
+    std::string out_path = argv[1];
+
+    // an archive left from the last run may sit inside a directory being packed
+    std::string skip = RealPath(out_path.c_str());
+
+    std::vector<PackFile> files;
+    for(int i=2; i<argc; ++i)
+    {
+        struct stat st;
+        if(stat(argv[i], &st) < 0)
+        {
+            fprintf(stderr, "assetpack: `%s` does not exist\n", argv[i]);
+            return 1;
+        }
+
+        if(S_ISDIR(st.st_mode))
+        {
+            if(!Walk(argv[i], "", skip, &files)) return 1;
+        }
+        else
+        {
+            PackFile file = { argv[i], argv[i], AssetArchive::Hash(argv[i]) };
+            files.push_back(file);
+        }
+    }
+
+    std::sort(files.begin(), files.end(), ByHash);
+    for(size_t i=1; i<files.size(); ++i)
+    {
+        if(files[i].name == files[i - 1].name)
+        {
+            fprintf(stderr, "assetpack: `%s` given twice\n", files[i].name.c_str());
+            return 1;
+        }
+    }
+
+    AssetHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ASSET_MAGIC;
+    header.version = ASSET_VERSION;
+    header.count = (Uint32)files.size();
+    header.index_offset = sizeof(AssetHeader);
+    header.names_offset = header.index_offset + files.size() * sizeof(AssetEntry);
+
+    std::vector<AssetEntry> entries(files.size());
+    std::string names;
+    for(size_t i=0; i<files.size(); ++i)
+    {
+        memset(&entries[i], 0, sizeof(AssetEntry));
+        entries[i].hash = files[i].hash;
+        entries[i].name_offset = (Uint32)names.size();
+        names.append(files[i].name.c_str(), files[i].name.size() + 1);
+    }
+
+    FILE *fh = fopen(out_path.c_str(), "wb");
+    if(!fh)
+    {
+        fprintf(stderr, "assetpack: error creating `%s`\n", out_path.c_str());
+        return 1;
+    }
+
+    // the index is written again once the payload offsets are known
+    fwrite(&header, sizeof(header), 1, fh);
+    if(!entries.empty()) fwrite(&entries[0], sizeof(AssetEntry), entries.size(), fh);
+    fwrite(names.data(), 1, names.size(), fh);
+    Uint64 offset = header.names_offset + names.size();
+
+    Uint64 total = 0, stored = 0;
+    std::vector<unsigned char> data, packed;
+    for(size_t i=0; i<files.size(); ++i)
+    {
+        if(!ReadFile(files[i].path.c_str(), &data))
+        {
+            fclose(fh);
+            remove(out_path.c_str());
+            return 1;
+        }
+
+        // only worth inflating on load if it saves an eighth
+        AssetArchive::Compress(data.empty() ? NULL : &data[0], data.size(), &packed);
+        bool b_compress = !data.empty() && packed.size() < data.size() - data.size() / 8;
+        const std::vector<unsigned char> &payload = b_compress ? packed : data;
+
+        Pad(fh, &offset);
+        AssetEntry &e = entries[i];
+        e.offset = offset;
+        e.size = (Uint32)data.size();
+        e.stored_size = (Uint32)payload.size();
+        e.flags = b_compress ? ASSET_COMPRESSED : 0;
+
+        if(!payload.empty()) fwrite(&payload[0], 1, payload.size(), fh);
+        offset += payload.size();
+
+        total += e.size;
+        stored += e.stored_size;
+    }
+
+    fseek(fh, (long)header.index_offset, SEEK_SET);
+    if(!entries.empty()) fwrite(&entries[0], sizeof(AssetEntry), entries.size(), fh);
+
+    bool b_ok = !ferror(fh);
+    if(fclose(fh) != 0) b_ok = false;
+    if(!b_ok)
+    {
+        fprintf(stderr, "assetpack: error writing `%s`\n", out_path.c_str());
+        remove(out_path.c_str());
+        return 1;
+    }
+
+    // read every file back through the archive before calling it done
+    AssetArchive archive;
+    if(!archive.Open(out_path.c_str())) return 1;
+    for(size_t i=0; i<files.size(); ++i)
+    {
+        const AssetEntry *e = archive.Find(files[i].name.c_str());
+        if(!e || !ReadFile(files[i].path.c_str(), &data) || e->size != data.size())
+        {
+            fprintf(stderr, "assetpack: `%s` did not read back\n", files[i].name.c_str());
+            return 1;
+        }
+
+        const unsigned char *payload = (const unsigned char *)archive.GetPayload(e);
+        if(e->flags & ASSET_COMPRESSED)
+        {
+            packed.resize(e->size);
+            if(!AssetArchive::Decompress(payload, e->stored_size, &packed[0], e->size)) packed.clear();
+            payload = packed.empty() ? NULL : &packed[0];
+        }
+
+        if(e->size && (!payload || memcmp(payload, &data[0], e->size) != 0))
+        {
+            fprintf(stderr, "assetpack: `%s` did not read back\n", files[i].name.c_str());
+            return 1;
+        }
+    }
+    archive.Close();
+
+    printf("assetpack: %u files, %llu bytes stored as %llu in `%s`\n", header.count,
+           (unsigned long long)total, (unsigned long long)stored, out_path.c_str());
+    return 0;
+}
@@ -38,13 +38,18 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+/* release builds call straight through, debug builds record the call for the
+ * KHR_debug callback and only fall back to glGetError without the extension
+ */
+#ifdef NDEBUG
+#define ASSERT_GL(CALL) \
+    CALL;
+#else
 #define ASSERT_GL(CALL) \
-    glGetError(); \
+    GLDebug::Enter(GAME_DOMAIN, #CALL); \
     CALL; \
-    { \
-        GLenum _err_ = glGetError(); \
-        if(_err_ != GL_NO_ERROR) fprintf(stderr, "OpenGL error 0x%x\n  » %s\n    » %s\n", _err_, GAME_DOMAIN, #CALL); \
-    }
+    GLDebug::Leave();
+#endif
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <minmax.h>
@@ -53,4 +58,7 @@
 #undef main
 #endif
 
+#include "GLDebug.h"
+#include "Profiler.h"
+
 #endif
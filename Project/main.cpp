@@ -19,9 +19,10 @@
 int main(int argc, const char **argv)
 {
     Game game;
-    int result = game.Run();
+    int result = game.Run(argc, argv);
 
-    if(result != 0)
+    // benchmarks run unattended
+    if(result != 0 && !game.bench.enabled)
     {
         fprintf(stderr, "FATAL ERROR: press enter key to exit\n");
         fgetc(stdin);